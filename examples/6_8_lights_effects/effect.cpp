@@ -30,6 +30,17 @@ lights[N_LIGHTS] = { { 3 }, { 4 }, { 5 }, { 6 }, { 7 }, { 8 }, { 9 }, { 10 } };
 lights[N_LIGHTS] = { { 3 }, { 4 }, { 5 }, { 6 }, { 7 }, { 8 }, { 9 }, { 10 } };
 #endif
 
+/**
+ * Set the brightness of all the lights at once, they change in the same semi-period.
+ */
+static void setFrame(const uint8_t frame[]) {
+#if defined(RAW_VALUES)
+  DimmableLight::setBrightnessAll(lights, frame, N_LIGHTS);
+#elif defined(LINEARIZED_VALUES)
+  DimmableLightLinearized::setBrightnessAll(lights, frame, N_LIGHTS);
+#endif
+}
+
 /**
  * Set particular values of brightness to every light.
  */
@@ -205,13 +216,15 @@ void doOnOffSweep() {
   const unsigned int period = 700;
   static int16_t step = 0;
 
+  uint8_t frame[N_LIGHTS];
   for (int i = 0; i < N_LIGHTS; i++) {
     if (step == i) {
-      lights[i].setBrightness(255);
+      frame[i] = 255;
     } else {
-      lights[i].setBrightness(0);
+      frame[i] = 0;
     }
   }
+  setFrame(frame);
 
   step++;
   if (step == N_LIGHTS) { step = 0; }
@@ -231,13 +244,15 @@ void doInvertedDim(void) {
   int oppositeBrightness = -((int)brightnessStep - 255);
 
   Serial.println(String("Dimming at: ") + brightnessStep + " " + oppositeBrightness + "/255");
+  uint8_t frame[N_LIGHTS];
   for (int i = 0; i < N_LIGHTS; i++) {
     if (i % 2 == 0) {
-      lights[i].setBrightness(brightnessStep);
+      frame[i] = brightnessStep;
     } else {
-      lights[i].setBrightness(oppositeBrightness);
+      frame[i] = oppositeBrightness;
     }
   }
+  setFrame(frame);
 
   if (brightnessStep == 255 && up) {
     up = false;
@@ -409,7 +424,8 @@ void doCircularSwipeRegular(void) {
 }
 
 void offAllLights() {
-  for (int i = 0; i < N_LIGHTS; i++) { lights[i].setBrightness(0); }
+  const uint8_t frame[N_LIGHTS] = { 0 };
+  setFrame(frame);
 }
 
 void initLights() {
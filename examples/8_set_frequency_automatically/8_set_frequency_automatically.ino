@@ -6,7 +6,8 @@
  * the actual frequency and then set the correct frequency. Since the
  * detected value may be imprecise due to noise, it is up to you
  * to implement the logic to chose the proper frequency. The frequency
- * is calculated with a moving average (by default on the last 5 values)
+ * is calculated with a moving average (by default on the last 8 semi-periods,
+ * see MONITOR_FREQUENCY_WINDOW in thyristor.cpp)
  * and it is continuosly updated.
  *
  * NOTE: you have to select NETWORK_FREQ_RUNTIME and MONITOR_FREQUENCY
@@ -0,0 +1,39 @@
+/**
+ * This example shows how to record the activity of the gates, to diagnose flickering without a
+ * logic analyzer. Send 't' over the serial port to start or stop the recording. The records are
+ * printed as text lines, save them in a file and convert it with extras/trace2vcd.py to view the
+ * waveforms in GTKWave.
+ *
+ * NOTE: you have to enable GATE_TRACE #define in thyristor.h (or in your build flags), and the
+ *       serial port must be fast enough to keep up with the recording.
+ */
+#include <dimmable_light.h>
+
+const int syncPin = 13;
+const int thyristorPin = 14;
+
+DimmableLight light(thyristorPin);
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial)
+    ;
+  Serial.println();
+  Serial.println("Dimmable Light for Arduino: gate trace");
+
+  Serial.print("Initializing DimmableLight library... ");
+  DimmableLight::setSyncPin(syncPin);
+  // VERY IMPORTANT: Call this method to activate the library
+  DimmableLight::begin();
+  Serial.println("Done!");
+
+  light.setBrightness(128);
+}
+
+void loop() {
+  if (Serial.available() && Serial.read() == 't') {
+    Thyristor::setTraceEnabled(!Thyristor::isTraceEnabled());
+  }
+
+  Thyristor::drainTrace(Serial);
+}
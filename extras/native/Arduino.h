@@ -0,0 +1,187 @@
+/******************************************************************************
+ *  This file is part of Dimmable Light for Arduino, a library to control     *
+ *  dimmers.                                                                  *
+ *                                                                            *
+ *  Copyright (C) 2018-2023  Fabiano Riccardi                                 *
+ *                                                                            *
+ *  Dimmable Light for Arduino is free software; you can redistribute         *
+ *  it and/or modify it under the terms of the GNU Lesser General Public      *
+ *  License as published by the Free Software Foundation; either              *
+ *  version 2.1 of the License, or (at your option) any later version.        *
+ *                                                                            *
+ *  This library is distributed in the hope that it will be useful,           *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU          *
+ *  Lesser General Public License for more details.                           *
+ *                                                                            *
+ *  You should have received a copy of the GNU Lesser General Public License  *
+ *  along with this library; if not, see <http://www.gnu.org/licenses/>.      *
+ ******************************************************************************/
+
+/***********************************************************************************
+ * Minimal Arduino API to build the library on the host (ARDUINO_ARCH_NATIVE). The
+ * functions are implemented by the simulator (see simulator.h), on a virtual clock.
+ ***********************************************************************************/
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <string.h>
+#include <string>
+
+#define HIGH          1
+#define LOW           0
+
+#define INPUT         0
+#define OUTPUT        1
+#define INPUT_PULLUP  2
+
+#define RISING        1
+#define FALLING       2
+#define CHANGE        3
+
+#define DEC           10
+#define HEX           16
+
+#define digitalPinToInterrupt(p) (p)
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+/**
+ * The zero-cross signal of the simulator is routed to any interrupt, regardless of the mode.
+ */
+void attachInterrupt(uint8_t interrupt, void (*isr)(), int mode);
+void detachInterrupt(uint8_t interrupt);
+
+unsigned long micros();
+unsigned long millis();
+
+/**
+ * Advance the virtual clock, serving the interrupts meanwhile (unless called by an interrupt).
+ */
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+/**
+ * The interrupts are served only while the virtual clock advances, so they never preempt the
+ * main program: these functions do nothing.
+ */
+static inline void noInterrupts() {}
+static inline void interrupts() {}
+
+class String {
+public:
+  String(const char *s = "") : s(s) {}
+  String(const std::string &s) : s(s) {}
+  explicit String(char c) : s(1, c) {}
+  String(int value) : s(std::to_string(value)) {}
+  String(unsigned int value) : s(std::to_string(value)) {}
+  String(long value) : s(std::to_string(value)) {}
+  String(unsigned long value) : s(std::to_string(value)) {}
+  String(double value) : s(std::to_string(value)) {}
+
+  const char *c_str() const {
+    return s.c_str();
+  }
+
+  unsigned int length() const {
+    return s.length();
+  }
+
+  String operator+(const String &other) const {
+    return String(s + other.s);
+  }
+
+  bool operator==(const String &other) const {
+    return s == other.s;
+  }
+
+private:
+  std::string s;
+};
+
+static inline String operator+(const char *a, const String &b) {
+  return String(a) + b;
+}
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (size--) { n += write(*buffer++); }
+    return n;
+  }
+
+  size_t print(const char *s) {
+    return write((const uint8_t *)s, strlen(s));
+  }
+  size_t print(const String &s) {
+    return print(s.c_str());
+  }
+  size_t print(char c) {
+    return write((uint8_t)c);
+  }
+  size_t print(int value, int base = DEC) {
+    return print((long)value, base);
+  }
+  size_t print(unsigned int value, int base = DEC) {
+    return print((unsigned long)value, base);
+  }
+  size_t print(long value, int base = DEC) {
+    if (value < 0 && base == DEC) { return print('-') + print((unsigned long)-value, base); }
+    return print((unsigned long)value, base);
+  }
+  size_t print(unsigned long value, int base = DEC) {
+    char buffer[8 * sizeof(value) + 1];
+    char *s = &buffer[sizeof(buffer) - 1];
+    *s = '\0';
+    do {
+      *--s = "0123456789abcdef"[value % base];
+      value /= base;
+    } while (value);
+    return print(s);
+  }
+  size_t print(double value) {
+    return print(String(value));
+  }
+
+  size_t println() {
+    return print('\n');
+  }
+  template<typename T> size_t println(const T &value) {
+    return print(value) + println();
+  }
+  template<typename T> size_t println(const T &value, int base) {
+    return print(value, base) + println();
+  }
+};
+
+/**
+ * Serial port on the standard output.
+ */
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long) {}
+  int available() {
+    return 0;
+  }
+  int read() {
+    return -1;
+  }
+  size_t write(uint8_t c) override;
+  using Print::write;
+  operator bool() {
+    return true;
+  }
+};
+
+extern HardwareSerial Serial;
+
+#endif  // ARDUINO_H
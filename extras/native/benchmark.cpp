@@ -0,0 +1,247 @@
+/******************************************************************************
+ *  This file is part of Dimmable Light for Arduino, a library to control     *
+ *  dimmers.                                                                  *
+ *                                                                            *
+ *  Copyright (C) 2018-2023  Fabiano Riccardi                                 *
+ *                                                                            *
+ *  Dimmable Light for Arduino is free software; you can redistribute         *
+ *  it and/or modify it under the terms of the GNU Lesser General Public      *
+ *  License as published by the Free Software Foundation; either              *
+ *  version 2.1 of the License, or (at your option) any later version.        *
+ *                                                                            *
+ *  This library is distributed in the hope that it will be useful,           *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU          *
+ *  Lesser General Public License for more details.                           *
+ *                                                                            *
+ *  You should have received a copy of the GNU Lesser General Public License  *
+ *  along with this library; if not, see <http://www.gnu.org/licenses/>.      *
+ ******************************************************************************/
+
+/**
+ * Measure the host time spent by the hot paths of the library, and print it as CSV:
+ *
+ *   benchmark,channels,merge_period,iterations,ns_per_op
+ *
+ * The benchmarks are:
+ *  set_delay                  Thyristor::setDelay(), with random delays on random thyristors
+ *  set_delays                 Thyristor::setDelays(), with random delays on all the thyristors
+ *  are_thyristors_on_off      Thyristor::areThyristorsOnOff(), with all the thyristors on or off
+ *  isr                        the interrupt routines, with random delays changed every 100
+ *                             semi-periods; a line per routine, e.g. zero_cross_int
+ *  linearized_set_brightness  DimmableLightLinearized::setBrightness(), with random brightness
+ *  manager_get_name           DimmableLightManager::get(String), with random names
+ *  manager_get_next           DimmableLightManager::get()
+ *
+ * Options:
+ *  -b <name>     benchmark to run (default set_delay)
+ *  -c <count>    number of channels (default 1, at most MAX_THYRISTORS)
+ *  -n <count>    iterations, i.e. calls or semi-periods for isr (default 100000)
+ *  -H            print the CSV header
+ *
+ * Each run creates its objects from scratch, so run a benchmark per process: benchmark.sh runs
+ * them all on several channel counts and Merge Periods.
+ */
+#include <Arduino.h>
+#include <thyristor.h>
+#include <dimmable_light_linearized.h>
+#include <dimmable_light_manager.h>
+#include "simulator.h"
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void zero_cross_int();
+void activate_thyristors();
+void turn_off_gates_int();
+#ifdef ZC_PLL
+void semi_period_int();
+#endif
+
+/**
+ * Access to the private methods of Thyristor.
+ */
+class ThyristorBenchmark {
+public:
+  static bool areThyristorsOnOff() {
+    return Thyristor::areThyristorsOnOff();
+  }
+};
+
+// The inputs are drawn in advance, so the random generator is not measured
+static const int inputs = 1024;
+
+static const uint8_t firstPin = 2;
+
+static int channels = 1;
+static uint32_t iterations = 100000;
+
+// Prevent the compiler from optimizing away the results
+static volatile uint32_t sink;
+
+static void print(const char *benchmark, uint64_t operations, double nanoseconds) {
+  printf("%s,%d,%u,%llu,%.1f\n", benchmark, channels, Thyristor::getMergePeriod(),
+         (unsigned long long)operations, operations ? nanoseconds / operations : 0.0);
+}
+
+/**
+ * Run the operation on the i-th input for every iteration, and print its average time.
+ */
+template<typename Operation> static void measure(const char *benchmark, Operation operation) {
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < iterations; i++) { operation(i % inputs); }
+  auto end = std::chrono::steady_clock::now();
+  print(benchmark, iterations, std::chrono::duration<double, std::nano>(end - start).count());
+}
+
+static void createThyristors(Thyristor *thyristors[]) {
+  for (int i = 0; i < channels; i++) { thyristors[i] = new Thyristor(firstPin + i); }
+  Thyristor::setSyncPin(0);
+  Thyristor::begin();
+}
+
+static void benchmarkSetDelay(std::minstd_rand &random) {
+  Thyristor *thyristors[Thyristor::N];
+  createThyristors(thyristors);
+
+  uint8_t targets[inputs];
+  uint16_t delays[inputs];
+  for (int i = 0; i < inputs; i++) {
+    targets[i] = random() % channels;
+    delays[i] = random() % (Thyristor::getSemiPeriod() + 1);
+  }
+  measure("set_delay", [&](int i) { thyristors[targets[i]]->setDelay(delays[i]); });
+}
+
+static void benchmarkSetDelays(std::minstd_rand &random) {
+  Thyristor *thyristors[Thyristor::N];
+  createThyristors(thyristors);
+
+  static uint16_t delays[inputs][Thyristor::N];
+  for (int i = 0; i < inputs; i++) {
+    for (int j = 0; j < channels; j++) { delays[i][j] = random() % (Thyristor::getSemiPeriod() + 1); }
+  }
+  measure("set_delays", [&](int i) { Thyristor::setDelays(thyristors, delays[i], channels); });
+}
+
+static void benchmarkAreThyristorsOnOff() {
+  Thyristor *thyristors[Thyristor::N];
+  createThyristors(thyristors);
+
+  // The worst case: every thyristor is checked
+  for (int i = 0; i < channels; i++) { thyristors[i]->setDelay(i % 2 ? Thyristor::getSemiPeriod() : 0); }
+  measure("are_thyristors_on_off", [](int) { sink = ThyristorBenchmark::areThyristorsOnOff(); });
+}
+
+static void benchmarkIsr(std::minstd_rand &random) {
+  Thyristor *thyristors[Thyristor::N];
+  createThyristors(thyristors);
+
+  const uint16_t semiPeriod = Thyristor::getSemiPeriod();
+  uint16_t delays[Thyristor::N];
+  Simulator::run(semiPeriod / 2);
+  for (uint32_t n = 0; n < iterations; n++) {
+    if (n % 100 == 0) {
+      for (int i = 0; i < channels; i++) { delays[i] = random() % (semiPeriod + 1); }
+      Thyristor::setDelays(thyristors, delays, channels);
+    }
+    // Skip the first semi-periods, to warm up the caches and the latency compensation
+    if (n == 100) { Simulator::setProfiling(true); }
+    Simulator::run(semiPeriod);
+  }
+
+  const struct {
+    const char *name;
+    void (*isr)();
+  } routines[] = {
+    { "zero_cross_int", zero_cross_int },
+    { "activate_thyristors", activate_thyristors },
+    { "turn_off_gates_int", turn_off_gates_int },
+#ifdef ZC_PLL
+    { "semi_period_int", semi_period_int },
+#endif
+  };
+  for (const auto &routine : routines) {
+    Simulator::InterruptProfile profile = Simulator::getProfile(routine.isr);
+    if (profile.count > 0) { print(routine.name, profile.count, profile.nanoseconds); }
+  }
+  Simulator::setProfiling(false);
+}
+
+static void benchmarkLinearizedSetBrightness(std::minstd_rand &random) {
+  DimmableLightLinearized *lights[Thyristor::N];
+  for (int i = 0; i < channels; i++) { lights[i] = new DimmableLightLinearized(firstPin + i); }
+  DimmableLightLinearized::setSyncPin(0);
+  DimmableLightLinearized::begin();
+
+  uint8_t targets[inputs];
+  uint8_t brightness[inputs];
+  for (int i = 0; i < inputs; i++) {
+    targets[i] = random() % channels;
+    brightness[i] = random();
+  }
+  measure("linearized_set_brightness",
+          [&](int i) { lights[targets[i]]->setBrightness(brightness[i]); });
+}
+
+static void benchmarkManager(const char *benchmark, std::minstd_rand &random) {
+  DimmableLightManager manager;
+  for (int i = 0; i < channels; i++) {
+    manager.add(String("light") + i, firstPin + i);
+  }
+  DimmableLight::setSyncPin(0);
+  DimmableLightManager::begin();
+
+  if (strcmp(benchmark, "manager_get_next") == 0) {
+    measure(benchmark, [&](int) { sink = (uintptr_t)manager.get().second; });
+    return;
+  }
+
+  // The names are built in advance, to measure the lookup only
+  static String names[inputs];
+  for (int i = 0; i < inputs; i++) { names[i] = String("light") + (int)(random() % channels); }
+  measure(benchmark, [&](int i) { sink = (uintptr_t)manager.get(names[i]); });
+}
+
+int main(int argc, char *argv[]) {
+  const char *benchmark = "set_delay";
+
+  int option;
+  while ((option = getopt(argc, argv, "b:c:n:H")) != -1) {
+    switch (option) {
+      case 'b': benchmark = optarg; break;
+      case 'c': channels = atoi(optarg); break;
+      case 'n': iterations = strtoul(optarg, nullptr, 10); break;
+      case 'H': printf("benchmark,channels,merge_period,iterations,ns_per_op\n"); return 0;
+      default: return 2;
+    }
+  }
+  if (channels < 1 || channels > Thyristor::N) {
+    fprintf(stderr, "invalid number of channels, at most %d\n", Thyristor::N);
+    return 2;
+  }
+
+  Simulator::reset();
+  std::minstd_rand random;
+
+  if (strcmp(benchmark, "set_delay") == 0) {
+    benchmarkSetDelay(random);
+  } else if (strcmp(benchmark, "set_delays") == 0) {
+    benchmarkSetDelays(random);
+  } else if (strcmp(benchmark, "are_thyristors_on_off") == 0) {
+    benchmarkAreThyristorsOnOff();
+  } else if (strcmp(benchmark, "isr") == 0) {
+    benchmarkIsr(random);
+  } else if (strcmp(benchmark, "linearized_set_brightness") == 0) {
+    benchmarkLinearizedSetBrightness(random);
+  } else if (strncmp(benchmark, "manager_get_", 12) == 0) {
+    benchmarkManager(benchmark, random);
+  } else {
+    fprintf(stderr, "unknown benchmark %s\n", benchmark);
+    return 2;
+  }
+  return 0;
+}
@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# This file is part of Dimmable Light for Arduino, a library to control dimmers.
+#
+# Copyright (C) 2018-2023  Fabiano Riccardi
+#
+# Dimmable Light for Arduino is free software; you can redistribute it and/or modify it under the
+# terms of the GNU Lesser General Public License as published by the Free Software Foundation;
+# either version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+# even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License along with this library;
+# if not, see <http://www.gnu.org/licenses/>.
+#
+# Build benchmark.cpp for every Merge Period, with the target benchmarks of CMakeLists.txt, and run
+# all the benchmarks on 1 to 32 channels, printing a single CSV on the standard output. Run it from
+# the root of the repository; the extra arguments are passed to the compiler (e.g. -DZC_PLL).
+#
+#   sh extras/native/benchmark.sh > benchmark.csv
+set -e
+
+MERGE_PERIODS=${MERGE_PERIODS:-"20 50 100"}
+CHANNELS=${CHANNELS:-"1 2 4 8 16 32"}
+BENCHMARKS="set_delay set_delays are_thyristors_on_off isr linearized_set_brightness
+  manager_get_name manager_get_next"
+
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+
+# The output of the build goes to the standard error, so it does not mix with the CSV
+cmake -S extras/native -B "$build" -DCMAKE_CXX_FLAGS="$*" \
+  -DBENCHMARK_MERGE_PERIODS="$(echo $MERGE_PERIODS | tr ' ' ';')" >&2
+cmake --build "$build" --target benchmarks >&2
+
+header=-H
+for mergePeriod in $MERGE_PERIODS; do
+  binary="$build/benchmark_$mergePeriod"
+  if [ -n "$header" ]; then
+    "$binary" $header
+    header=
+  fi
+  for benchmark in $BENCHMARKS; do
+    for channels in $CHANNELS; do
+      "$binary" -b "$benchmark" -c "$channels"
+    done
+  done
+done
@@ -0,0 +1,246 @@
+/******************************************************************************
+ *  This file is part of Dimmable Light for Arduino, a library to control     *
+ *  dimmers.                                                                  *
+ *                                                                            *
+ *  Copyright (C) 2018-2023  Fabiano Riccardi                                 *
+ *                                                                            *
+ *  Dimmable Light for Arduino is free software; you can redistribute         *
+ *  it and/or modify it under the terms of the GNU Lesser General Public      *
+ *  License as published by the Free Software Foundation; either              *
+ *  version 2.1 of the License, or (at your option) any later version.        *
+ *                                                                            *
+ *  This library is distributed in the hope that it will be useful,           *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU          *
+ *  Lesser General Public License for more details.                           *
+ *                                                                            *
+ *  You should have received a copy of the GNU Lesser General Public License  *
+ *  along with this library; if not, see <http://www.gnu.org/licenses/>.      *
+ ******************************************************************************/
+
+/**
+ * Check the burst-fire pattern shared by the thyristors in burst-fire mode, for several mixes of
+ * duties: each thyristor must conduct exactly its duty in every period of the pattern (i.e. the
+ * least common multiple of the windows, at most BURST_PATTERN_SIZE semi-periods, where the duties
+ * are rounded), and the number of thyristors conducting together must differ by 1 at most among
+ * the semi-periods. The mixes needing more than MAX_THYRISTORS thyristors are skipped. Then, the
+ * same is checked on random mixes, printing only the failed ones.
+ *
+ * Options:
+ *  -r <count>    number of random mixes (default 1000)
+ *  -v            print the pattern of each mix, a line per semi-period
+ *
+ * The exit status is 1 if any check failed.
+ */
+#include <Arduino.h>
+#include <thyristor.h>
+#include "simulator.h"
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+#ifndef BURST_FIRE
+#error "burst.cpp requires BURST_FIRE"
+#endif
+
+static const uint8_t firstPin = 2;
+
+/**
+ * Duty of a thyristor: semi-periods conducted out of the window.
+ */
+struct Duty {
+  uint16_t on;
+  uint16_t window;
+};
+
+struct Mix {
+  const char *name;
+  std::vector<Duty> duties;
+};
+
+/**
+ * Thyristors conducting in each semi-period, a bit per thyristor.
+ */
+static std::vector<uint32_t> conducting;
+static uint64_t recordFrom = UINT64_MAX;
+
+static void onTransition(const Simulator::Transition &t) {
+  if (t.level != HIGH || t.pin < firstPin || t.pin >= firstPin + Thyristor::N
+      || t.pin >= firstPin + 32) {
+    return;
+  }
+  const uint64_t zc = Simulator::getZeroCrossings();
+  if (zc < recordFrom) { return; }
+  if (conducting.size() <= zc - recordFrom) { conducting.resize(zc - recordFrom + 1); }
+  conducting[zc - recordFrom] |= (uint32_t)1 << (t.pin - firstPin);
+}
+
+static uint32_t greatestCommonDivisor(uint32_t a, uint32_t b) {
+  while (b) {
+    uint32_t r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+/**
+ * Run the mix for 3 periods of its pattern and check it. Return false if any check failed. The
+ * result is printed if it failed, or if *print*.
+ */
+static bool checkMix(Thyristor *thyristors[], const Mix &mix, bool print, bool verbose) {
+  const int n = mix.duties.size();
+
+  // The simulated GPIOs are a single port, so the pattern can take the whole BURST_PATTERN_SIZE.
+  // The thyristors never conducting are not in the pattern.
+  uint32_t period = 1;
+  for (const Duty &d : mix.duties) {
+    if (d.on == 0) { continue; }
+    period = period / greatestCommonDivisor(period, d.window) * d.window;
+    if (period > BURST_PATTERN_SIZE) { period = BURST_PATTERN_SIZE; }
+  }
+  std::vector<uint32_t> expected;
+  uint32_t total = 0;
+  for (const Duty &d : mix.duties) {
+    expected.push_back(((uint32_t)d.on * period + d.window / 2) / d.window);
+    total += expected.back();
+  }
+
+  for (int i = 0; i < Thyristor::N; i++) {
+    if (i < n) {
+      thyristors[i]->setBurstFire(mix.duties[i].on, mix.duties[i].window);
+    } else {
+      // Always off
+      thyristors[i]->setDelay(Thyristor::getSemiPeriod());
+    }
+  }
+
+  // The new pattern is applied from the next semi-period
+  const uint16_t semiPeriod = Thyristor::getSemiPeriod();
+  Simulator::run(2 * semiPeriod);
+  conducting.clear();
+  recordFrom = Simulator::getZeroCrossings() + 1;
+  Simulator::run((uint64_t)3 * period * semiPeriod + semiPeriod / 2);
+  recordFrom = UINT64_MAX;
+  const uint32_t length = 3 * period;
+  conducting.resize(length);
+
+  bool ok = true;
+  std::vector<uint32_t> wrong(n);
+  for (int i = 0; i < n; i++) {
+    uint32_t count = 0;
+    for (uint32_t k = 0; k < length; k++) {
+      count += conducting[k] >> i & 1;
+      if (k >= period) { count -= conducting[k - period] >> i & 1; }
+      if (k + 1 >= period && count != expected[i]) { wrong[i]++; }
+    }
+    if (wrong[i]) { ok = false; }
+  }
+
+  // The total of the duties spread evenly over the period
+  const uint32_t minLoad = total / period;
+  const uint32_t maxLoad = (total + period - 1) / period;
+  uint32_t low = UINT32_MAX;
+  uint32_t high = 0;
+  for (uint32_t k = 0; k < length; k++) {
+    const uint32_t load = __builtin_popcount(conducting[k]);
+    if (load < low) { low = load; }
+    if (load > high) { high = load; }
+    if (verbose) {
+      for (int i = 0; i < n; i++) { putchar(conducting[k] >> i & 1 ? '#' : '.'); }
+      printf("  %u\n", load);
+    }
+  }
+  if (low < minLoad || high > maxLoad) { ok = false; }
+
+  if (print || !ok) {
+    printf("%-28s period %3u  load [%u; %u], expected [%u; %u]  %s\n", mix.name, period, low,
+           high, minLoad, maxLoad, ok ? "ok" : "FAILED");
+  }
+  // The duties of a failed random mix are printed to reproduce it
+  for (int i = 0; i < n; i++) {
+    if (wrong[i] || (!ok && !print)) {
+      printf("  thyristor %d (%u/%u): %u periods without %u semi-periods\n", i, mix.duties[i].on,
+             mix.duties[i].window, wrong[i], expected[i]);
+    }
+  }
+  return ok;
+}
+
+int main(int argc, char *argv[]) {
+  int randomMixes = 1000;
+  bool verbose = false;
+  int option;
+  while ((option = getopt(argc, argv, "r:v")) != -1) {
+    switch (option) {
+      case 'r': randomMixes = atoi(optarg); break;
+      case 'v': verbose = true; break;
+      default: return 2;
+    }
+  }
+
+  const Mix mixes[] = {
+    { "8 at 5/10", { { 5, 10 }, { 5, 10 }, { 5, 10 }, { 5, 10 },
+                     { 5, 10 }, { 5, 10 }, { 5, 10 }, { 5, 10 } } },
+    { "1/10 to 8/10", { { 1, 10 }, { 2, 10 }, { 3, 10 }, { 4, 10 },
+                        { 5, 10 }, { 6, 10 }, { 7, 10 }, { 8, 10 } } },
+    { "windows 10, 20, 50", { { 3, 10 }, { 7, 20 }, { 11, 50 }, { 1, 20 }, { 49, 50 } } },
+    { "off and full", { { 0, 10 }, { 10, 10 }, { 3, 4 }, { 1, 2 } } },
+    { "windows 3, 7, 11", { { 1, 3 }, { 2, 7 }, { 3, 11 } } },
+    { "rounded 3, 7, 11, 13", { { 1, 3 }, { 2, 7 }, { 3, 11 }, { 5, 13 } } },
+    { "single 1/7", { { 1, 7 } } },
+    { "full among 29", { { 10, 29 }, { 2, 29 }, { 29, 29 } } },
+    { "full among 64", { { 64, 64 }, { 49, 64 }, { 58, 64 }, { 3, 64 },
+                         { 39, 64 }, { 1, 64 }, { 1, 64 } } },
+    { "16 at 1/16 to 16/16", { { 1, 16 }, { 2, 16 }, { 3, 16 }, { 4, 16 },
+                               { 5, 16 }, { 6, 16 }, { 7, 16 }, { 8, 16 },
+                               { 9, 16 }, { 10, 16 }, { 11, 16 }, { 12, 16 },
+                               { 13, 16 }, { 14, 16 }, { 15, 16 }, { 16, 16 } } },
+  };
+
+  Simulator::reset();
+  Simulator::setMainsFrequency(Thyristor::getFrequency());
+  Simulator::setGpioListener(onTransition);
+
+  Thyristor *thyristors[Thyristor::N];
+  for (int i = 0; i < Thyristor::N; i++) { thyristors[i] = new Thyristor(firstPin + i); }
+  Thyristor::setSyncPin(0);
+  Thyristor::begin();
+  Simulator::run(Thyristor::getSemiPeriod() / 2);
+
+  bool ok = true;
+  for (const Mix &mix : mixes) {
+    // The bits of conducting, besides MAX_THYRISTORS
+    if (mix.duties.size() > Thyristor::N || mix.duties.size() > 32) {
+      printf("%-28s skipped, it needs %u thyristors\n", mix.name, (unsigned)mix.duties.size());
+      continue;
+    }
+    ok = checkMix(thyristors, mix, true, verbose) && ok;
+  }
+
+  // Half of the thyristors share the window, so the pattern is often exact, and a mix out of 4 has
+  // a thyristor at full duty
+  const int maxChannels = Thyristor::N < 32 ? Thyristor::N : 32;
+  std::minstd_rand random;
+  int failed = 0;
+  for (int r = 0; r < randomMixes; r++) {
+    Mix mix = { "random", {} };
+    const int n = 1 + random() % maxChannels;
+    const uint16_t window = 1 + random() % 64;
+    for (int i = 0; i < n; i++) {
+      Duty d;
+      d.window = random() % 2 ? window : 1 + random() % 64;
+      d.on = random() % (d.window + 1);
+      mix.duties.push_back(d);
+    }
+    if (random() % 4 == 0) {
+      Duty &d = mix.duties[random() % n];
+      d.on = d.window;
+    }
+    if (!checkMix(thyristors, mix, false, verbose)) { failed++; }
+  }
+  if (randomMixes) { printf("%d random mixes, %d failed\n", randomMixes, failed); }
+  return ok && failed == 0 ? 0 : 1;
+}
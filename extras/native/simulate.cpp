@@ -0,0 +1,388 @@
+/******************************************************************************
+ *  This file is part of Dimmable Light for Arduino, a library to control     *
+ *  dimmers.                                                                  *
+ *                                                                            *
+ *  Copyright (C) 2018-2023  Fabiano Riccardi                                 *
+ *                                                                            *
+ *  Dimmable Light for Arduino is free software; you can redistribute         *
+ *  it and/or modify it under the terms of the GNU Lesser General Public      *
+ *  License as published by the Free Software Foundation; either              *
+ *  version 2.1 of the License, or (at your option) any later version.        *
+ *                                                                            *
+ *  This library is distributed in the hope that it will be useful,           *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU          *
+ *  Lesser General Public License for more details.                           *
+ *                                                                            *
+ *  You should have received a copy of the GNU Lesser General Public License  *
+ *  along with this library; if not, see <http://www.gnu.org/licenses/>.      *
+ ******************************************************************************/
+
+/**
+ * Run the thyristor engine on the simulator for many semi-periods, changing the delays at random,
+ * and check that every gate is fired once per semi-period at the expected time. With
+ * PREDEFINED_PULSE_LENGTH, each thyristor has its own pulse width, and the length of the pulses is
+ * checked too. With BURST_FIRE, the last thyristors can be driven in burst-fire mode, each one with
+ * its own duty: their gates must be raised and lowered only at the zero cross, and they must
+ * conduct the requested number of semi-periods.
+ *
+ * Options:
+ *  -f <Hz>       frequency of the electrical network, it must match the one of the library unless
+ *                NETWORK_FREQ_RUNTIME is enabled (default 50)
+ *  -n <count>    number of semi-periods to simulate (default 100000)
+ *  -c <count>    number of thyristors (default 4, at most MAX_THYRISTORS)
+ *  -l <us>       latency of the timer interrupt (default 0)
+ *  -j <us>       jitter of the zero-cross edges (default 0)
+ *  -o <us>       offset of the zero-cross edges, compensated by setZeroCrossOffset() (default 0)
+ *  -w <path>     write the waveforms of the first 100 semi-periods into a VCD file
+ *  -b <count>    number of thyristors in burst-fire mode, among the last ones (default 0, requires
+ *                BURST_FIRE)
+ *
+ * The exit status is 1 if any check failed.
+ */
+#include <Arduino.h>
+#include <thyristor.h>
+#include "simulator.h"
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#ifdef BURST_FIRE
+#include <vector>
+#endif
+
+// Delays are drawn far from the margins, where the thyristors are fully on or off
+static const uint16_t minDelay = 300;
+static const uint16_t maxDelayMargin = 600;
+
+// Semi-periods simulated before checking, to let the latency compensation converge. The checks
+// start from the semi-period after the calibration.
+static const uint32_t warmup = 100;
+
+// How early and late a thyristor may be fired, besides the Merge Period (see
+// Thyristor::getMergePeriod()). The events are anticipated
+// by the timer latency, so an event closer than the latency to the previous one is served by the
+// same interrupt, i.e. early.
+static uint16_t earlyTolerance = 2;
+static uint16_t lateTolerance = 2;
+
+static const uint8_t firstPin = 2;
+
+static uint64_t checkFrom = UINT64_MAX;
+static uint16_t delays[2][Thyristor::N];
+static uint64_t activeFrom = 0;
+static uint8_t current = 0;
+static uint64_t lastFired[Thyristor::N];
+
+static uint64_t checked = 0;
+static uint64_t wrongTime = 0;
+static uint64_t missed = 0;
+static int32_t minError = INT32_MAX;
+static int32_t maxError = INT32_MIN;
+
+#ifdef PREDEFINED_PULSE_LENGTH
+static Thyristor *thyristors[Thyristor::N];
+static uint64_t firedAt[Thyristor::N];
+static uint64_t checkedPulses = 0;
+static uint64_t wrongPulse = 0;
+static uint16_t firedDelay[Thyristor::N];
+static uint16_t pulseTolerance = 2;
+
+// The pulses are cut at the gate-off, this time before the end of the semi-period (see
+// gateTurnOffTime in thyristor.cpp)
+static const uint16_t gateTurnOffTime = 300;
+
+/**
+ * A pulse may be longer by the Merge Period, since its end is merged into a later one. Both ends
+ * may be served early or late by the latency, as the firings. A pulse lasting beyond the gate-off
+ * is cut there.
+ */
+static void checkPulse(uint8_t i, uint64_t time) {
+  if (firedAt[i] == 0 || Simulator::getZeroCrossings() < checkFrom) { return; }
+  const uint64_t length = time - firedAt[i];
+  const uint16_t available = Thyristor::getSemiPeriod() - gateTurnOffTime - firedDelay[i];
+  uint16_t width = thyristors[i]->getPulseWidth();
+  if (width > available) { width = available; }
+  if (length + pulseTolerance < width
+      || length > (uint64_t)width + Thyristor::getMergePeriod() + pulseTolerance) {
+    wrongPulse++;
+  }
+  checkedPulses++;
+  firedAt[i] = 0;
+}
+#endif
+
+#ifdef BURST_FIRE
+static int firstBurst = Thyristor::N;
+static uint16_t burstOn[Thyristor::N];
+static uint16_t burstWindow[Thyristor::N];
+
+/**
+ * Semi-periods conducted by each thyristor in burst-fire mode, from the first checked one.
+ */
+static std::vector<uint8_t> conducted[Thyristor::N];
+
+static uint64_t checkedBurst = 0;
+static uint64_t wrongBurst = 0;
+static uint64_t checkedWindows = 0;
+static uint64_t wrongDuty = 0;
+
+// How early and late a gate in burst-fire mode may be raised or lowered. The zero-cross interrupt
+// (the timer with ZC_PLL) writes it as soon as served, without compensating the offset of the
+// edges and the latency.
+static uint16_t burstEarlyTolerance = 2;
+static uint16_t burstLateTolerance = 2;
+
+/**
+ * A gate in burst-fire mode is raised and lowered only at the zero cross, so it is high for whole
+ * semi-periods. An edge may come before the zero cross, so the transition is accounted to the
+ * closest one.
+ */
+static void checkBurstGate(uint8_t i, const Simulator::Transition &t) {
+  uint64_t zc = Simulator::getZeroCrossings();
+  int32_t error = (int32_t)(t.time - Simulator::getLastZeroCrossing());
+  if (error > Thyristor::getSemiPeriod() / 2) {
+    zc++;
+    error -= Thyristor::getSemiPeriod();
+  }
+  if (zc < checkFrom) { return; }
+  if (t.level == HIGH) {
+    if (conducted[i].size() <= zc - checkFrom) { conducted[i].resize(zc - checkFrom + 1); }
+    conducted[i][zc - checkFrom] = 1;
+  }
+  if (error > burstLateTolerance || error < -(int32_t)burstEarlyTolerance) { wrongBurst++; }
+  checkedBurst++;
+}
+
+static uint16_t greatestCommonDivisor(uint16_t a, uint16_t b) {
+  while (b) {
+    uint16_t r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+/**
+ * Check the semi-periods conducted by each thyristor in burst-fire mode: any window has the
+ * requested number of them, give or take one, and any period of the pattern (i.e. the least common
+ * multiple of the windows) has exactly the requested duty.
+ */
+static void checkDuties(int channels, uint64_t semiPeriods) {
+  uint32_t period = 1;
+  for (int i = firstBurst; i < channels; i++) {
+    period = period / greatestCommonDivisor(period, burstWindow[i]) * burstWindow[i];
+  }
+  for (int i = firstBurst; i < channels; i++) {
+    std::vector<uint8_t> &c = conducted[i];
+    c.resize(semiPeriods);
+    const uint32_t spans[] = { burstWindow[i], period };
+    for (uint32_t span : spans) {
+      const uint32_t expected = (uint32_t)burstOn[i] * span / burstWindow[i];
+      uint32_t count = 0;
+      for (uint64_t k = 0; k < semiPeriods; k++) {
+        count += c[k];
+        if (k < span) { continue; }
+        count -= c[k - span];
+        const bool exact = span == period;
+        if (exact ? count != expected : (count + 1 < expected || count > expected + 1)) {
+          wrongDuty++;
+        }
+        checkedWindows++;
+      }
+    }
+  }
+}
+#endif
+
+static void onTransition(const Simulator::Transition &t) {
+  if (t.pin < firstPin || t.pin >= firstPin + Thyristor::N) { return; }
+
+  uint8_t i = t.pin - firstPin;
+#ifdef BURST_FIRE
+  if (i >= firstBurst) {
+    checkBurstGate(i, t);
+    return;
+  }
+#endif
+#ifdef PREDEFINED_PULSE_LENGTH
+  if (t.level == LOW) {
+    checkPulse(i, t.time);
+    return;
+  }
+  firedAt[i] = t.time;
+#endif
+  if (t.level != HIGH) { return; }
+  uint64_t zc = Simulator::getZeroCrossings();
+  const uint16_t *active = zc >= activeFrom ? delays[current] : delays[current ^ 1];
+#ifdef PREDEFINED_PULSE_LENGTH
+  firedDelay[i] = active[i];
+#endif
+  if (zc >= checkFrom) {
+    int32_t error = (int32_t)(t.time - Simulator::getLastZeroCrossing()) - active[i];
+    if (error < minError) { minError = error; }
+    if (error > maxError) { maxError = error; }
+    if (error > lateTolerance || error < -(int32_t)(earlyTolerance + Thyristor::getMergePeriod())) { wrongTime++; }
+    if (lastFired[i] + 1 != zc) { missed++; }
+    checked++;
+  }
+  lastFired[i] = zc;
+}
+
+int main(int argc, char *argv[]) {
+  double frequency = 50;
+  uint64_t semiPeriods = 100000;
+  int channels = 4;
+  int burst = 0;
+  uint16_t latency = 0;
+  uint16_t jitter = 0;
+  int16_t offset = 0;
+  const char *vcd = nullptr;
+
+  int option;
+  while ((option = getopt(argc, argv, "f:n:c:l:j:o:w:b:")) != -1) {
+    switch (option) {
+      case 'f': frequency = atof(optarg); break;
+      case 'n': semiPeriods = strtoull(optarg, nullptr, 10); break;
+      case 'c': channels = atoi(optarg); break;
+      case 'l': latency = atoi(optarg); break;
+      case 'j': jitter = atoi(optarg); break;
+      case 'o': offset = atoi(optarg); break;
+      case 'w': vcd = optarg; break;
+      case 'b': burst = atoi(optarg); break;
+      default: return 2;
+    }
+  }
+#ifndef NETWORK_FREQ_RUNTIME
+  if (frequency != Thyristor::getFrequency()) {
+    fprintf(stderr, "the frequency must be %g Hz, unless NETWORK_FREQ_RUNTIME is enabled\n",
+            Thyristor::getFrequency());
+    return 2;
+  }
+#endif
+#ifndef BURST_FIRE
+  if (burst) {
+    fprintf(stderr, "the burst-fire mode requires BURST_FIRE\n");
+    return 2;
+  }
+#endif
+  if (channels < 1 || channels > Thyristor::N || burst < 0 || burst > channels || frequency <= 0) {
+    fprintf(stderr, "invalid options\n");
+    return 2;
+  }
+
+  Simulator::reset();
+  Simulator::setMainsFrequency(frequency);
+  Simulator::setTimerLatency(latency);
+  Simulator::setZeroCrossJitter(jitter);
+  Simulator::setZeroCrossOffset(offset);
+  Simulator::setGpioListener(onTransition);
+  Simulator::setRecording(vcd != nullptr);
+  earlyTolerance += jitter + latency;
+  lateTolerance += jitter;
+#ifdef BURST_FIRE
+  burstEarlyTolerance += jitter + (offset < 0 ? -offset : 0);
+  burstLateTolerance += jitter + latency + (offset > 0 ? offset : 0);
+#endif
+
+#ifdef PREDEFINED_PULSE_LENGTH
+  pulseTolerance += latency;
+#else
+  Thyristor *thyristors[Thyristor::N];
+#endif
+  for (int i = 0; i < channels; i++) { thyristors[i] = new Thyristor(firstPin + i); }
+#ifdef PREDEFINED_PULSE_LENGTH
+  for (int i = 0; i < channels; i++) { thyristors[i]->setPulseWidth(10 + 40 * i); }
+#endif
+#ifdef BURST_FIRE
+  // Windows dividing 20, so the pattern repeats every 20 semi-periods with exact duties
+  firstBurst = channels - burst;
+  for (int i = firstBurst; i < channels; i++) {
+    const uint16_t windows[] = { 10, 4, 20, 5 };
+    const int j = i - firstBurst;
+    burstWindow[i] = windows[j % 4];
+    burstOn[i] = (3 * j + 1) % (burstWindow[i] + 1);
+    thyristors[i]->setBurstFire(burstOn[i], burstWindow[i]);
+  }
+  const int phaseChannels = firstBurst;
+#else
+  const int phaseChannels = channels;
+#endif
+#ifdef NETWORK_FREQ_RUNTIME
+  Thyristor::setFrequency(frequency);
+#endif
+  Thyristor::setZeroCrossOffset(offset);
+  Thyristor::setSyncPin(0);
+  Thyristor::begin();
+
+  const uint16_t semiPeriod = Thyristor::getSemiPeriod();
+  std::minstd_rand random;
+  auto start = std::chrono::steady_clock::now();
+
+  // Step in the middle of the semi-periods, so the new delays are applied from the next one
+  Simulator::run(semiPeriod / 2);
+  for (uint64_t n = 0; n < semiPeriods; n++) {
+    if (n % 100 == 0) {
+      current ^= 1;
+      for (int i = 0; i < phaseChannels; i++) {
+        delays[current][i] = minDelay + random() % (semiPeriod - maxDelayMargin - minDelay);
+      }
+      activeFrom = Simulator::getZeroCrossings() + 1;
+      Thyristor::setDelays(thyristors, delays[current], phaseChannels);
+    }
+    if (n == warmup) {
+      Thyristor::calibrate();
+      checkFrom = Simulator::getZeroCrossings() + 1;
+    }
+    if (n == 100 && vcd != nullptr) {
+      Simulator::setRecording(false);
+      if (!Simulator::writeVcd(vcd)) { fprintf(stderr, "cannot write %s\n", vcd); }
+    }
+    // Step to the middle of the next semi-period of the simulator, since the one of the library is
+    // rounded, so the delays are never changed next to a jittered edge
+    const uint64_t middle = Simulator::getLastZeroCrossing() + semiPeriod + semiPeriod / 2;
+    Simulator::run(middle - Simulator::now());
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+#ifdef BURST_FIRE
+  // The last semi-period is not over
+  checkDuties(channels, Simulator::getZeroCrossings() - checkFrom);
+#endif
+  printf("semi-periods:    %llu (%.0f per second)\n", (unsigned long long)semiPeriods,
+         semiPeriods / seconds);
+  printf("checked firings: %llu\n", (unsigned long long)checked);
+  printf("firing error:    [%d; %d] us\n", checked ? minError : 0, checked ? maxError : 0);
+  printf("wrong time:      %llu\n", (unsigned long long)wrongTime);
+  printf("missed:          %llu\n", (unsigned long long)missed);
+#ifdef PREDEFINED_PULSE_LENGTH
+  printf("checked pulses:  %llu\n", (unsigned long long)checkedPulses);
+  printf("wrong pulse:     %llu\n", (unsigned long long)wrongPulse);
+#endif
+#ifdef BURST_FIRE
+  if (burst) {
+    printf("checked bursts:  %llu\n", (unsigned long long)checkedBurst);
+    printf("wrong burst:     %llu\n", (unsigned long long)wrongBurst);
+    printf("checked windows: %llu\n", (unsigned long long)checkedWindows);
+    printf("wrong duty:      %llu\n", (unsigned long long)wrongDuty);
+  }
+#endif
+  printf("ISR latency:     %u us\n", Thyristor::getIsrLatency());
+  printf("Merge Period:    %u us\n", Thyristor::getMergePeriod());
+#ifdef ISR_STATS
+  Thyristor::Stats stats = Thyristor::getStats();
+  printf("zero-cross ISR:  %u calls, max %u ns\n", stats.zeroCross.count, stats.zeroCross.maxCycles);
+  printf("activate ISR:    %u calls, max %u ns\n", stats.activate.count, stats.activate.maxCycles);
+  printf("turn-off ISR:    %u calls, max %u ns\n", stats.turnOff.count, stats.turnOff.maxCycles);
+  printf("late events:     %u\n", stats.lateEvents);
+#endif
+
+#ifdef PREDEFINED_PULSE_LENGTH
+  if (phaseChannels && (wrongPulse || checkedPulses == 0)) { return 1; }
+#endif
+#ifdef BURST_FIRE
+  if (burst && (wrongBurst || wrongDuty || checkedBurst == 0 || checkedWindows == 0)) { return 1; }
+#endif
+  return phaseChannels && (wrongTime || missed || checked == 0) ? 1 : 0;
+}
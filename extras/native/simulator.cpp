@@ -0,0 +1,347 @@
+/******************************************************************************
+ *  This file is part of Dimmable Light for Arduino, a library to control     *
+ *  dimmers.                                                                  *
+ *                                                                            *
+ *  Copyright (C) 2018-2023  Fabiano Riccardi                                 *
+ *                                                                            *
+ *  Dimmable Light for Arduino is free software; you can redistribute         *
+ *  it and/or modify it under the terms of the GNU Lesser General Public      *
+ *  License as published by the Free Software Foundation; either              *
+ *  version 2.1 of the License, or (at your option) any later version.        *
+ *                                                                            *
+ *  This library is distributed in the hope that it will be useful,           *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU          *
+ *  Lesser General Public License for more details.                           *
+ *                                                                            *
+ *  You should have received a copy of the GNU Lesser General Public License  *
+ *  along with this library; if not, see <http://www.gnu.org/licenses/>.      *
+ ******************************************************************************/
+#include "simulator.h"
+#include <Arduino.h>
+#include <hw_timer_native.h>
+#include <fast_gpio.h>
+#include <chrono>
+#include <map>
+#include <random>
+#include <stdio.h>
+
+HardwareSerial Serial;
+
+static uint64_t virtualTime = 0;
+
+static double semiPeriod = 1000000.0 / 2 / 50;
+static uint64_t zeroCrossings = 0;
+
+/**
+ * Time of the next actual zero crossing, it is kept as double to not accumulate the rounding.
+ */
+static double nextZeroCrossing = 0;
+static uint64_t lastZeroCrossing = 0;
+static int16_t zeroCrossOffset = 0;
+static uint16_t zeroCrossJitter = 0;
+static std::minstd_rand randomGenerator;
+
+/**
+ * Time of the next zero-cross edge and of the zero crossing it refers to, if the signal is present.
+ */
+static bool zeroCrossActive = true;
+static uint64_t nextEdge = 0;
+static double nextEdgeZeroCrossing = 0;
+static void (*zeroCrossIsr)() = nullptr;
+
+static bool alarmPending = false;
+static uint64_t alarmTime = 0;
+static void (*alarmCallback)() = nullptr;
+static uint16_t timerLatency = 0;
+
+static bool inInterrupt = false;
+
+static bool profiling = false;
+static std::map<void (*)(), Simulator::InterruptProfile> profiles;
+
+/**
+ * Host time spent to measure an empty routine, in nanoseconds.
+ */
+static uint64_t profilingOverhead = 0;
+
+static void emptyRoutine() {}
+
+/**
+ * Serve an interrupt, measuring it if enabled.
+ */
+static void serve(void (*isr)()) {
+  if (isr == nullptr) { return; }
+  if (!profiling) {
+    isr();
+    return;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  isr();
+  auto end = std::chrono::steady_clock::now();
+  uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+  Simulator::InterruptProfile &profile = profiles[isr];
+  profile.count++;
+  profile.nanoseconds += elapsed > profilingOverhead ? elapsed - profilingOverhead : 0;
+}
+
+static uint64_t levels = 0;
+static bool recording = false;
+static std::vector<Simulator::Transition> transitions;
+static void (*gpioListener)(const Simulator::Transition &transition) = nullptr;
+
+/**
+ * Compute the time of the edge for the next zero crossing.
+ */
+static void scheduleEdge() {
+  int64_t edge = (int64_t)(nextEdgeZeroCrossing + 0.5) + zeroCrossOffset;
+  if (zeroCrossJitter) {
+    edge += (int64_t)(randomGenerator() % (2 * zeroCrossJitter + 1)) - zeroCrossJitter;
+  }
+  nextEdge = edge < (int64_t)virtualTime ? virtualTime : edge;
+}
+
+/**
+ * Serve the events up to the given time, in chronological order. The timer has the precedence on
+ * the zero-cross edge at the same time.
+ */
+static void advance(uint64_t until) {
+  for (;;) {
+    uint64_t alarm = alarmTime + timerLatency;
+    bool timerDue = alarmPending && alarm <= until;
+    bool edgeDue = zeroCrossActive && nextEdge <= until;
+    bool timerFirst = timerDue && (!edgeDue || alarm <= nextEdge);
+    uint64_t time = !timerDue && !edgeDue ? until : timerFirst ? alarm : nextEdge;
+
+    // Count the zero crossings up to the next event
+    while (zeroCrossActive && nextZeroCrossing <= time) {
+      lastZeroCrossing = (uint64_t)(nextZeroCrossing + 0.5);
+      zeroCrossings++;
+      nextZeroCrossing += semiPeriod;
+    }
+
+    if (time > virtualTime) { virtualTime = time; }
+    if (!timerDue && !edgeDue) { return; }
+
+    inInterrupt = true;
+    if (timerFirst) {
+      alarmPending = false;
+      serve(alarmCallback);
+    } else {
+      nextEdgeZeroCrossing += semiPeriod;
+      scheduleEdge();
+      serve(zeroCrossIsr);
+    }
+    inInterrupt = false;
+  }
+}
+
+void Simulator::reset() {
+  virtualTime = 0;
+  semiPeriod = 1000000.0 / 2 / 50;
+  zeroCrossings = 0;
+  nextZeroCrossing = 0;
+  nextEdgeZeroCrossing = 0;
+  lastZeroCrossing = 0;
+  zeroCrossOffset = 0;
+  zeroCrossJitter = 0;
+  zeroCrossActive = true;
+  scheduleEdge();
+  alarmPending = false;
+  timerLatency = 0;
+  levels = 0;
+  transitions.clear();
+}
+
+void Simulator::setMainsFrequency(double frequency) {
+  zeroCrossActive = frequency > 0;
+  if (!zeroCrossActive) { return; }
+  semiPeriod = 1000000.0 / 2 / frequency;
+  if (nextZeroCrossing < virtualTime) {
+    nextZeroCrossing = virtualTime;
+    nextEdgeZeroCrossing = virtualTime;
+  }
+  scheduleEdge();
+}
+
+void Simulator::setZeroCrossOffset(int16_t offset) {
+  zeroCrossOffset = offset;
+  scheduleEdge();
+}
+
+void Simulator::setZeroCrossJitter(uint16_t jitter) {
+  zeroCrossJitter = jitter;
+}
+
+void Simulator::setTimerLatency(uint16_t latency) {
+  timerLatency = latency;
+}
+
+void Simulator::run(uint64_t duration) {
+  advance(virtualTime + duration);
+}
+
+uint64_t Simulator::now() {
+  return virtualTime;
+}
+
+uint64_t Simulator::getLastZeroCrossing() {
+  return lastZeroCrossing;
+}
+
+uint64_t Simulator::getZeroCrossings() {
+  return zeroCrossings;
+}
+
+void Simulator::setGpioListener(void (*listener)(const Transition &transition)) {
+  gpioListener = listener;
+}
+
+void Simulator::setRecording(bool enable) {
+  recording = enable;
+}
+
+const std::vector<Simulator::Transition> &Simulator::getTransitions() {
+  return transitions;
+}
+
+void Simulator::clearTransitions() {
+  transitions.clear();
+}
+
+bool Simulator::writeVcd(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == nullptr) { return false; }
+
+  uint64_t pins = 0;
+  for (const Transition &t : transitions) { pins |= (uint64_t)1 << t.pin; }
+
+  fprintf(file, "$timescale 1us $end\n$scope module board $end\n");
+  for (int pin = 0; pin < 64; pin++) {
+    if (pins >> pin & 1) { fprintf(file, "$var wire 1 %c gpio_%d $end\n", 33 + pin, pin); }
+  }
+  fprintf(file, "$upscope $end\n$enddefinitions $end\n");
+
+  uint64_t time = UINT64_MAX;
+  for (const Transition &t : transitions) {
+    if (t.time != time) {
+      time = t.time;
+      fprintf(file, "#%llu\n", (unsigned long long)time);
+    }
+    fprintf(file, "%d%c\n", t.level, 33 + t.pin);
+  }
+  return fclose(file) == 0;
+}
+
+uint8_t Simulator::getLevel(uint8_t pin) {
+  return levels >> (pin & 63) & 1;
+}
+
+void Simulator::setProfiling(bool enable) {
+  profiles.clear();
+  profiling = enable;
+  if (!enable) { return; }
+
+  // The overhead is the lowest average over a few batches of empty routines
+  profilingOverhead = 0;
+  uint64_t best = UINT64_MAX;
+  for (int batch = 0; batch < 10; batch++) {
+    for (int i = 0; i < 1000; i++) { serve(emptyRoutine); }
+    uint64_t average = profiles[emptyRoutine].nanoseconds / profiles[emptyRoutine].count;
+    if (average < best) { best = average; }
+    profiles.clear();
+  }
+  profilingOverhead = best;
+}
+
+Simulator::InterruptProfile Simulator::getProfile(void (*isr)()) {
+  auto it = profiles.find(isr);
+  return it == profiles.end() ? InterruptProfile{ 0, 0 } : it->second;
+}
+
+/***********************************************************************************
+ * Hooks of the native timer and GPIOs (see hw_timer_native.h and fast_gpio.h)
+ ***********************************************************************************/
+
+uint64_t nativeClock() {
+  return virtualTime;
+}
+
+void nativeScheduleAlarm(uint64_t time, void (*callback)()) {
+  alarmPending = true;
+  alarmTime = time;
+  alarmCallback = callback;
+}
+
+void nativeCancelAlarm() {
+  alarmPending = false;
+}
+
+uint32_t nativeCycleCount() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+void nativeGpioWrite(uint64_t mask, uint8_t level) {
+  uint64_t changed = mask & (level ? ~levels : levels);
+  if (changed == 0) { return; }
+  levels ^= changed;
+
+  if (!recording && gpioListener == nullptr) { return; }
+  for (uint8_t pin = 0; changed; pin++, changed >>= 1) {
+    if (!(changed & 1)) { continue; }
+    Simulator::Transition t = { virtualTime, pin, level };
+    if (recording) { transitions.push_back(t); }
+    if (gpioListener != nullptr) { gpioListener(t); }
+  }
+}
+
+/***********************************************************************************
+ * Arduino API
+ ***********************************************************************************/
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  nativeGpioWrite((uint64_t)1 << (pin & 63), value ? HIGH : LOW);
+}
+
+int digitalRead(uint8_t pin) {
+  return Simulator::getLevel(pin);
+}
+
+void attachInterrupt(uint8_t, void (*isr)(), int) {
+  zeroCrossIsr = isr;
+}
+
+void detachInterrupt(uint8_t) {
+  zeroCrossIsr = nullptr;
+}
+
+unsigned long micros() {
+  return (uint32_t)virtualTime;
+}
+
+unsigned long millis() {
+  return (uint32_t)(virtualTime / 1000);
+}
+
+void delay(unsigned long ms) {
+  delayMicroseconds(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  // Busy wait within an interrupt
+  if (inInterrupt) {
+    virtualTime += us;
+  } else {
+    advance(virtualTime + us);
+  }
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return fputc(c, stdout) == EOF ? 0 : 1;
+}
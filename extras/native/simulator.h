@@ -0,0 +1,132 @@
+/******************************************************************************
+ *  This file is part of Dimmable Light for Arduino, a library to control     *
+ *  dimmers.                                                                  *
+ *                                                                            *
+ *  Copyright (C) 2018-2023  Fabiano Riccardi                                 *
+ *                                                                            *
+ *  Dimmable Light for Arduino is free software; you can redistribute         *
+ *  it and/or modify it under the terms of the GNU Lesser General Public      *
+ *  License as published by the Free Software Foundation; either              *
+ *  version 2.1 of the License, or (at your option) any later version.        *
+ *                                                                            *
+ *  This library is distributed in the hope that it will be useful,           *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU          *
+ *  Lesser General Public License for more details.                           *
+ *                                                                            *
+ *  You should have received a copy of the GNU Lesser General Public License  *
+ *  along with this library; if not, see <http://www.gnu.org/licenses/>.      *
+ ******************************************************************************/
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Discrete-event simulator of the board running the library on the host: a virtual clock, the
+ * zero-cross signal of the electrical network, the timer alarm and the GPIOs. The interrupts are
+ * served, in chronological order, only while the virtual clock advances (see run() and delay()),
+ * hence they never preempt the main program.
+ */
+class Simulator {
+public:
+  /**
+   * A change of level of a GPIO.
+   */
+  struct Transition {
+    uint64_t time;
+    uint8_t pin;
+    uint8_t level;
+  };
+
+  /**
+   * Reset the virtual clock, the GPIOs and the settings to the default ones.
+   */
+  static void reset();
+
+  /**
+   * Set the frequency of the electrical network, in Hz. There is a zero crossing per semi-period,
+   * the first one at the start of the simulation. 0 stops the zero-cross signal.
+   */
+  static void setMainsFrequency(double frequency);
+
+  /**
+   * Set the delay of the zero-cross edges w.r.t. the actual zero crossings, in microseconds.
+   */
+  static void setZeroCrossOffset(int16_t offset);
+
+  /**
+   * Set the maximum jitter of the zero-cross edges, in microseconds. Each edge is moved by a
+   * random value in [-jitter; jitter].
+   */
+  static void setZeroCrossJitter(uint16_t jitter);
+
+  /**
+   * Set the latency of the timer interrupt, in microseconds.
+   */
+  static void setTimerLatency(uint16_t latency);
+
+  /**
+   * Advance the virtual clock by the given microseconds, serving the interrupts.
+   */
+  static void run(uint64_t duration);
+
+  /**
+   * Return the virtual time, in microseconds.
+   */
+  static uint64_t now();
+
+  /**
+   * Return the time of the last actual zero crossing, in microseconds.
+   */
+  static uint64_t getLastZeroCrossing();
+
+  /**
+   * Return the number of zero crossings so far.
+   */
+  static uint64_t getZeroCrossings();
+
+  /**
+   * Call the listener on every change of level of a GPIO.
+   */
+  static void setGpioListener(void (*listener)(const Transition &transition));
+
+  /**
+   * Store the changes of level of the GPIOs, see getTransitions().
+   */
+  static void setRecording(bool enable);
+
+  static const std::vector<Transition> &getTransitions();
+
+  static void clearTransitions();
+
+  /**
+   * Write the recorded transitions into a VCD file. Return false on error.
+   */
+  static bool writeVcd(const char *path);
+
+  /**
+   * Return the level of a GPIO.
+   */
+  static uint8_t getLevel(uint8_t pin);
+
+  /**
+   * Host time spent by an interrupt routine.
+   */
+  struct InterruptProfile {
+    uint64_t count;
+    uint64_t nanoseconds;
+  };
+
+  /**
+   * Measure the host time spent by each interrupt routine called by the simulator, net of the
+   * overhead of the measurement. The routines called by other routines are not measured
+   * separately.
+   */
+  static void setProfiling(bool enable);
+
+  static InterruptProfile getProfile(void (*isr)());
+};
+
+#endif  // SIMULATOR_H
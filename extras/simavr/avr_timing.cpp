@@ -0,0 +1,414 @@
+/******************************************************************************
+ *  This file is part of Dimmable Light for Arduino, a library to control     *
+ *  dimmers.                                                                  *
+ *                                                                            *
+ *  Copyright (C) 2018-2023  Fabiano Riccardi                                 *
+ *                                                                            *
+ *  Dimmable Light for Arduino is free software; you can redistribute         *
+ *  it and/or modify it under the terms of the GNU Lesser General Public      *
+ *  License as published by the Free Software Foundation; either              *
+ *  version 2.1 of the License, or (at your option) any later version.        *
+ *                                                                            *
+ *  This library is distributed in the hope that it will be useful,           *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU          *
+ *  Lesser General Public License for more details.                           *
+ *                                                                            *
+ *  You should have received a copy of the GNU Lesser General Public License  *
+ *  along with this library; if not, see <http://www.gnu.org/licenses/>.      *
+ ******************************************************************************/
+
+/**
+ * Run an Arduino Uno firmware (ELF) in simavr, drive its zero-cross pin and check the timing of
+ * the gates in CPU cycles: the firing error w.r.t. the expected delays and the duration of every
+ * interrupt routine, from its vector to the RETI.
+ *
+ * Options:
+ *  -m <mcu>        MCU model (default atmega328p)
+ *  -F <Hz>         CPU frequency (default 16000000)
+ *  -z <pin>        Arduino pin of the zero-cross signal (default 2)
+ *  -g <pins>       comma-separated Arduino pins of the gates (default 3)
+ *  -d <us>         comma-separated expected delays of the gates; without it, the delays are only
+ *                  measured
+ *  -f <Hz>         frequency of the electrical network (default 50)
+ *  -w <us>         width of the zero-cross pulses, starting at the zero crossing (default 200)
+ *  -j <us>         jitter of the zero-cross edges (default 0)
+ *  -s <path>       read the zero-cross signal from a VCD file (the first 1-bit variable) or from a
+ *                  text file with a "<time in us> <level>" line per edge, instead of generating it
+ *  -t <s>          simulated time (default 5)
+ *  -W <count>      semi-periods skipped before checking (default 100)
+ *  -e <us>         how early a gate may be fired, i.e. the Merge Period (default 25)
+ *  -l <us>         how late a gate may be fired (default 20)
+ *  -i <cycles>     maximum duration of an interrupt routine (default 0, i.e. not checked)
+ *  -o <path>       write the zero-cross and gate waveforms into a VCD file
+ *
+ * The exit status is 1 if any check failed.
+ */
+extern "C" {
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/avr_ioport.h>
+}
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Port and bit of an Arduino Uno pin.
+ */
+struct PortPin {
+  char port;
+  int bit;
+};
+
+static bool unoPin(int pin, PortPin &out) {
+  if (pin >= 0 && pin <= 7) {
+    out = { 'D', pin };
+  } else if (pin >= 8 && pin <= 13) {
+    out = { 'B', pin - 8 };
+  } else if (pin >= 14 && pin <= 19) {
+    out = { 'C', pin - 14 };
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Names of the ATmega328P interrupt vectors
+static const char *const vectorNames[] = {
+  "RESET",        "INT0",         "INT1",         "PCINT0",      "PCINT1",      "PCINT2",
+  "WDT",          "TIMER2_COMPA", "TIMER2_COMPB", "TIMER2_OVF",  "TIMER1_CAPT", "TIMER1_COMPA",
+  "TIMER1_COMPB", "TIMER1_OVF",   "TIMER0_COMPA", "TIMER0_COMPB", "TIMER0_OVF", "SPI_STC",
+  "USART_RX",     "USART_UDRE",   "USART_TX",     "ADC",          "EE_READY",    "ANALOG_COMP",
+  "TWI",          "SPM_READY",
+};
+static const int nVectors = sizeof(vectorNames) / sizeof(vectorNames[0]);
+
+struct Edge {
+  avr_cycle_count_t cycle;
+  uint8_t level;
+};
+
+struct Transition {
+  avr_cycle_count_t cycle;
+  int signal;  // 0 is the zero-cross signal, i+1 is the i-th gate
+  uint8_t level;
+};
+
+struct IsrProfile {
+  uint64_t count;
+  avr_cycle_count_t minCycles;
+  avr_cycle_count_t maxCycles;
+};
+
+static avr_t *avr = nullptr;
+static double cyclesPerMicro = 16;
+
+static std::vector<Edge> stimulus;
+static size_t nextEdge = 0;
+static avr_irq_t *zeroCrossIrq = nullptr;
+static avr_cycle_count_t lastZeroCross = 0;
+static uint64_t zeroCrossings = 0;
+
+static std::vector<int> gatePins;
+static std::vector<long> expectedDelays;
+static uint64_t checkFrom = 100;
+static long earlyTolerance = 25;
+static long lateTolerance = 20;
+
+static uint64_t checked = 0;
+static uint64_t wrongTime = 0;
+static long minError = 0;
+static long maxError = 0;
+static std::vector<long> minDelay, maxDelay;
+
+static bool recording = false;
+static std::vector<Transition> transitions;
+
+static IsrProfile profiles[nVectors];
+
+static avr_cycle_count_t driveZeroCross(avr_t *, avr_cycle_count_t, void *) {
+  const Edge &edge = stimulus[nextEdge++];
+  if (edge.level) {
+    lastZeroCross = edge.cycle;
+    zeroCrossings++;
+  }
+  if (recording) { transitions.push_back({ edge.cycle, 0, edge.level }); }
+  avr_raise_irq(zeroCrossIrq, edge.level);
+  return nextEdge < stimulus.size() ? stimulus[nextEdge].cycle : 0;
+}
+
+static void onGate(avr_irq_t *, uint32_t value, void *param) {
+  size_t i = (size_t)param;
+  if (recording) { transitions.push_back({ avr->cycle, (int)i + 1, (uint8_t)value }); }
+  if (!value || zeroCrossings < checkFrom) { return; }
+
+  long delay = (long)(avr->cycle - lastZeroCross);
+  if (minDelay[i] < 0 || delay < minDelay[i]) { minDelay[i] = delay; }
+  if (delay > maxDelay[i]) { maxDelay[i] = delay; }
+  if (i >= expectedDelays.size()) { return; }
+
+  long error = delay - (long)(expectedDelays[i] * cyclesPerMicro);
+  if (checked == 0 || error < minError) { minError = error; }
+  if (checked == 0 || error > maxError) { maxError = error; }
+  if (error > lateTolerance * cyclesPerMicro || error < -earlyTolerance * cyclesPerMicro) {
+    wrongTime++;
+  }
+  checked++;
+}
+
+static std::vector<long> parseList(const char *list) {
+  std::vector<long> values;
+  char *end = (char *)list;
+  do {
+    values.push_back(strtol(end, &end, 10));
+  } while (*end++ == ',');
+  return values;
+}
+
+/**
+ * Read the edges from a VCD file, following the first 1-bit variable.
+ */
+static bool readVcd(FILE *file) {
+  char token[256];
+  std::string id;
+  double unit = 1e-6;
+  uint64_t time = 0;
+  while (fscanf(file, "%255s", token) == 1) {
+    if (strcmp(token, "$timescale") == 0) {
+      char scale[64];
+      if (fscanf(file, "%63s", scale) != 1) { return false; }
+      double multiplier = atof(scale);
+      if (multiplier == 0) { multiplier = 1; }
+      const char *suffix = scale + strspn(scale, "0123456789");
+      if (*suffix == 0 && fscanf(file, "%63s", scale) == 1) { suffix = scale; }
+      double base = strcmp(suffix, "s") == 0    ? 1
+                    : strcmp(suffix, "ms") == 0 ? 1e-3
+                    : strcmp(suffix, "us") == 0 ? 1e-6
+                    : strcmp(suffix, "ns") == 0 ? 1e-9
+                    : strcmp(suffix, "ps") == 0 ? 1e-12
+                                                : 1e-15;
+      unit = multiplier * base;
+    } else if (strcmp(token, "$var") == 0 && id.empty()) {
+      char type[64], width[16], name[64];
+      if (fscanf(file, "%63s %15s %255s %63s", type, width, token, name) != 4) { return false; }
+      if (strcmp(width, "1") == 0) { id = token; }
+    } else if (token[0] == '#') {
+      time = strtoull(token + 1, nullptr, 10);
+    } else if ((token[0] == '0' || token[0] == '1') && !id.empty() && id == token + 1) {
+      avr_cycle_count_t cycle = time * unit * 1e6 * cyclesPerMicro;
+      stimulus.push_back({ cycle, (uint8_t)(token[0] - '0') });
+    }
+  }
+  return !id.empty();
+}
+
+/**
+ * Read the edges from a text file, a "<time in us> <level>" line per edge.
+ */
+static void readText(FILE *file) {
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    double time;
+    int level;
+    if (line[0] == '#' || sscanf(line, "%lf %d", &time, &level) != 2) { continue; }
+    stimulus.push_back({ (avr_cycle_count_t)(time * cyclesPerMicro), (uint8_t)(level != 0) });
+  }
+}
+
+static bool writeVcd(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == nullptr) { return false; }
+
+  // A cycle is 1e6/cyclesPerMicro ps
+  uint64_t picoPerCycle = (uint64_t)(1e6 / cyclesPerMicro);
+  fprintf(file, "$timescale 1ps $end\n$scope module avr $end\n");
+  fprintf(file, "$var wire 1 ! zero_cross $end\n");
+  for (size_t i = 0; i < gatePins.size(); i++) {
+    fprintf(file, "$var wire 1 %c gate_%d $end\n", (char)('"' + i), gatePins[i]);
+  }
+  fprintf(file, "$upscope $end\n$enddefinitions $end\n");
+  avr_cycle_count_t last = ~(avr_cycle_count_t)0;
+  for (const Transition &t : transitions) {
+    if (t.cycle != last) { fprintf(file, "#%llu\n", (unsigned long long)(t.cycle * picoPerCycle)); }
+    last = t.cycle;
+    fprintf(file, "%u%c\n", t.level, (char)('!' + t.signal));
+  }
+  return fclose(file) == 0;
+}
+
+int main(int argc, char *argv[]) {
+  const char *mcu = "atmega328p";
+  uint32_t cpuFrequency = 16000000;
+  int zeroCrossPin = 2;
+  double frequency = 50;
+  double width = 200;
+  double jitter = 0;
+  const char *stimulusPath = nullptr;
+  double seconds = 5;
+  long maxIsrCycles = 0;
+  const char *vcd = nullptr;
+  gatePins = { 3 };
+
+  int option;
+  while ((option = getopt(argc, argv, "m:F:z:g:d:f:w:j:s:t:W:e:l:i:o:")) != -1) {
+    switch (option) {
+      case 'm': mcu = optarg; break;
+      case 'F': cpuFrequency = strtoul(optarg, nullptr, 10); break;
+      case 'z': zeroCrossPin = atoi(optarg); break;
+      case 'g': {
+        gatePins.clear();
+        for (long pin : parseList(optarg)) { gatePins.push_back(pin); }
+        break;
+      }
+      case 'd': expectedDelays = parseList(optarg); break;
+      case 'f': frequency = atof(optarg); break;
+      case 'w': width = atof(optarg); break;
+      case 'j': jitter = atof(optarg); break;
+      case 's': stimulusPath = optarg; break;
+      case 't': seconds = atof(optarg); break;
+      case 'W': checkFrom = strtoull(optarg, nullptr, 10); break;
+      case 'e': earlyTolerance = atol(optarg); break;
+      case 'l': lateTolerance = atol(optarg); break;
+      case 'i': maxIsrCycles = atol(optarg); break;
+      case 'o': vcd = optarg; break;
+      default: return 2;
+    }
+  }
+  if (optind != argc - 1 || frequency <= 0 || expectedDelays.size() > gatePins.size()) {
+    fprintf(stderr, "usage: %s [options] firmware.elf\n", argv[0]);
+    return 2;
+  }
+  cyclesPerMicro = cpuFrequency / 1e6;
+
+  elf_firmware_t firmware;
+  memset(&firmware, 0, sizeof(firmware));
+  if (elf_read_firmware(argv[optind], &firmware) != 0) {
+    fprintf(stderr, "cannot read %s\n", argv[optind]);
+    return 2;
+  }
+  avr = avr_make_mcu_by_name(firmware.mmcu[0] ? firmware.mmcu : mcu);
+  if (avr == nullptr) {
+    fprintf(stderr, "unknown MCU %s\n", mcu);
+    return 2;
+  }
+  avr_init(avr);
+  avr_load_firmware(avr, &firmware);
+  avr->frequency = cpuFrequency;
+
+  // The zero-cross signal, generated or read from a file
+  if (stimulusPath != nullptr) {
+    FILE *file = fopen(stimulusPath, "r");
+    if (file == nullptr) {
+      fprintf(stderr, "cannot read %s\n", stimulusPath);
+      return 2;
+    }
+    const char *extension = strrchr(stimulusPath, '.');
+    if (extension != nullptr && strcmp(extension, ".vcd") == 0) {
+      if (!readVcd(file)) {
+        fprintf(stderr, "no 1-bit variable in %s\n", stimulusPath);
+        return 2;
+      }
+    } else {
+      readText(file);
+    }
+    fclose(file);
+    std::stable_sort(stimulus.begin(), stimulus.end(),
+                     [](const Edge &a, const Edge &b) { return a.cycle < b.cycle; });
+  } else {
+    std::minstd_rand random;
+    std::uniform_real_distribution<double> noise(-jitter, jitter);
+    double semiPeriod = 1e6 / frequency / 2;
+    for (double t = semiPeriod; t < seconds * 1e6; t += semiPeriod) {
+      double edge = t + (jitter > 0 ? noise(random) : 0);
+      stimulus.push_back({ (avr_cycle_count_t)(edge * cyclesPerMicro), 1 });
+      stimulus.push_back({ (avr_cycle_count_t)((edge + width) * cyclesPerMicro), 0 });
+    }
+  }
+  if (stimulus.empty()) {
+    fprintf(stderr, "no zero-cross edge\n");
+    return 2;
+  }
+
+  PortPin portPin;
+  if (!unoPin(zeroCrossPin, portPin)) {
+    fprintf(stderr, "invalid pin %d\n", zeroCrossPin);
+    return 2;
+  }
+  zeroCrossIrq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(portPin.port), portPin.bit);
+  avr_cycle_timer_register(avr, stimulus[0].cycle, driveZeroCross, nullptr);
+
+  minDelay.assign(gatePins.size(), -1);
+  maxDelay.assign(gatePins.size(), -1);
+  for (size_t i = 0; i < gatePins.size(); i++) {
+    if (!unoPin(gatePins[i], portPin)) {
+      fprintf(stderr, "invalid pin %d\n", gatePins[i]);
+      return 2;
+    }
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(portPin.port), portPin.bit),
+                            onGate, (void *)i);
+  }
+  recording = vcd != nullptr;
+
+  // Step an instruction at a time: an interrupt routine starts when the PC reaches its vector, and
+  // it ends when the stack pointer gets back above the return address (i.e. after the RETI)
+  struct Active {
+    int vector;
+    uint16_t sp;
+    avr_cycle_count_t start;
+  } stack[8];
+  int depth = 0;
+  const avr_cycle_count_t end = (avr_cycle_count_t)(seconds * cpuFrequency);
+  int state = cpu_Running;
+  while (avr->cycle < end && state != cpu_Done && state != cpu_Crashed) {
+    state = avr_run(avr);
+
+    uint16_t sp = avr->data[R_SPL] | avr->data[R_SPH] << 8;
+    while (depth > 0 && sp > stack[depth - 1].sp) {
+      depth--;
+      IsrProfile &profile = profiles[stack[depth].vector];
+      avr_cycle_count_t cycles = avr->cycle - stack[depth].start;
+      if (profile.count == 0 || cycles < profile.minCycles) { profile.minCycles = cycles; }
+      if (cycles > profile.maxCycles) { profile.maxCycles = cycles; }
+      profile.count++;
+    }
+    int vector = avr->pc / avr->vector_size;
+    if (avr->pc % avr->vector_size == 0 && vector > 0 && vector < nVectors && depth < 8) {
+      stack[depth++] = { vector, sp, avr->cycle };
+    }
+  }
+  if (state == cpu_Crashed) { fprintf(stderr, "the firmware crashed\n"); }
+
+  printf("simulated:       %.3f s, %llu zero crossings\n", avr->cycle / (double)cpuFrequency,
+         (unsigned long long)zeroCrossings);
+  for (size_t i = 0; i < gatePins.size(); i++) {
+    printf("gate %-2d delay:   [%ld; %ld] cycles\n", gatePins[i], minDelay[i], maxDelay[i]);
+  }
+  if (!expectedDelays.empty()) {
+    printf("checked firings: %llu\n", (unsigned long long)checked);
+    printf("firing error:    [%ld; %ld] cycles\n", minError, maxError);
+    printf("wrong time:      %llu\n", (unsigned long long)wrongTime);
+  }
+
+  bool isrTooLong = false;
+  printf("%-15s %10s %10s %10s\n", "ISR", "calls", "min", "max");
+  for (int i = 1; i < nVectors; i++) {
+    if (profiles[i].count == 0) { continue; }
+    printf("%-15s %10llu %10llu %10llu\n", vectorNames[i], (unsigned long long)profiles[i].count,
+           (unsigned long long)profiles[i].minCycles, (unsigned long long)profiles[i].maxCycles);
+    if (maxIsrCycles > 0 && profiles[i].maxCycles > (avr_cycle_count_t)maxIsrCycles) {
+      isrTooLong = true;
+    }
+  }
+
+  if (vcd != nullptr && !writeVcd(vcd)) { fprintf(stderr, "cannot write %s\n", vcd); }
+
+  bool failed = state == cpu_Crashed || wrongTime > 0 || isrTooLong
+                || (!expectedDelays.empty() && checked == 0);
+  return failed ? 1 : 0;
+}
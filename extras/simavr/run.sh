@@ -0,0 +1,49 @@
+#!/bin/sh
+#
+# This file is part of Dimmable Light for Arduino, a library to control dimmers.
+#
+# Copyright (C) 2018-2023  Fabiano Riccardi
+#
+# Dimmable Light for Arduino is free software; you can redistribute it and/or modify it under the
+# terms of the GNU Lesser General Public License as published by the Free Software Foundation;
+# either version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+# even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License along with this library;
+# if not, see <http://www.gnu.org/licenses/>.
+#
+# Build the timing firmware for the Arduino Uno with 1 to 8 channels and check it in simavr. Run it
+# from the root of the repository; the extra arguments are the library options of the build (e.g.
+# -DZC_PLL). It needs arduino-cli (with the arduino:avr core) and simavr.
+#
+#   sh extras/simavr/run.sh -DZC_PLL
+set -e
+
+CHANNELS=${CHANNELS:-"1 2 4 8"}
+# Same delays of timing.ino
+DELAYS="1000 1010 2500 4000 5000 6000 7500 8500"
+# Maximum duration of an interrupt routine, in cycles (0 to not check it)
+MAX_ISR_CYCLES=${MAX_ISR_CYCLES:-0}
+
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+
+${CXX:-g++} -std=gnu++11 -O2 extras/simavr/avr_timing.cpp -lsimavr -lelf -o "$build/avr_timing"
+
+status=0
+for channels in $CHANNELS; do
+  pins=$(seq -s, 3 $((channels + 2)))
+  delays=$(echo $DELAYS | cut -d' ' -f1-"$channels" | tr ' ' ,)
+
+  arduino-cli compile --fqbn arduino:avr:uno --library . --output-dir "$build/$channels" \
+    --build-property "compiler.cpp.extra_flags=-DCHANNELS=$channels $*" extras/simavr/timing \
+    > /dev/null
+
+  echo "== $channels channels $*"
+  "$build/avr_timing" -g "$pins" -d "$delays" -i "$MAX_ISR_CYCLES" "$build/$channels/timing.ino.elf" \
+    || status=1
+done
+exit $status
@@ -0,0 +1,30 @@
+/**
+ * Firmware for the AVR timing checks (see extras/simavr/README.md): the zero-cross signal is on
+ * pin 2 and CHANNELS thyristors (1 to 8) are on the pins from 3, with fixed delays. Some delays are
+ * closer than the Merge Period, to exercise the merged events.
+ *
+ * Keep the delays in sync with run.sh.
+ */
+#include <thyristor.h>
+
+#ifndef CHANNELS
+#define CHANNELS 4
+#endif
+
+const int syncPin = 2;
+const int firstPin = 3;
+
+const uint16_t delays[] = { 1000, 1010, 2500, 4000, 5000, 6000, 7500, 8500 };
+
+Thyristor *thyristors[CHANNELS];
+
+void setup() {
+  for (int i = 0; i < CHANNELS; i++) { thyristors[i] = new Thyristor(firstPin + i); }
+
+  Thyristor::setSyncPin(syncPin);
+  Thyristor::begin();
+
+  for (int i = 0; i < CHANNELS; i++) { thyristors[i]->setDelay(delays[i]); }
+}
+
+void loop() {}
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+#
+# This file is part of Dimmable Light for Arduino, a library to control dimmers.
+#
+# Copyright (C) 2018-2023  Fabiano Riccardi
+#
+# Dimmable Light for Arduino is free software; you can redistribute it and/or modify it under the
+# terms of the GNU Lesser General Public License as published by the Free Software Foundation;
+# either version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+# even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License along with this library;
+# if not, see <http://www.gnu.org/licenses/>.
+"""
+Convert the gate trace printed by Thyristor::drainTrace() (see GATE_TRACE in thyristor.h) into a
+VCD file, viewable with GTKWave.
+
+Usage:
+    python3 trace2vcd.py serial_dump.txt > trace.vcd
+    python3 trace2vcd.py < serial_dump.txt > trace.vcd
+
+The lines not matching the trace format (e.g. other messages of the sketch) are ignored.
+"""
+import re
+import sys
+
+LINE = re.compile(r"^\s*(\d+) ([ZSHLD]) ([0-9a-fA-F]+)\s*$")
+
+
+def parse(lines):
+    """Yield (time, type, value), with the time unwrapped from the 32-bit micros()."""
+    offset = 0
+    last = None
+    for line in lines:
+        match = LINE.match(line)
+        if not match:
+            continue
+        time = int(match.group(1)) + offset
+        if last is not None and time < last - (1 << 31):
+            offset += 1 << 32
+            time += 1 << 32
+        last = time
+        yield time, match.group(2), int(match.group(3), 16)
+
+
+def identifier(index):
+    """Return the VCD identifier of the index-th variable."""
+    chars = ""
+    index += 1
+    while index:
+        index, rest = divmod(index - 1, 94)
+        chars += chr(33 + rest)
+    return chars
+
+
+def main():
+    source = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+    records = list(parse(source))
+    if not records:
+        sys.exit("no trace record found")
+
+    pins = 0
+    for _, kind, value in records:
+        if kind in "HL":
+            pins |= value
+    pins = [pin for pin in range(64) if pins >> pin & 1]
+
+    ids = {"Z": identifier(0), "S": identifier(1), "D": identifier(2)}
+    for i, pin in enumerate(pins):
+        ids[pin] = identifier(3 + i)
+
+    out = sys.stdout
+    out.write("$timescale 1us $end\n")
+    out.write("$scope module dimmer $end\n")
+    out.write("$var event 1 %s zero_cross $end\n" % ids["Z"])
+    out.write("$var event 1 %s semi_period $end\n" % ids["S"])
+    out.write("$var integer 32 %s dropped $end\n" % ids["D"])
+    for pin in pins:
+        out.write("$var wire 1 %s gate_%d $end\n" % (ids[pin], pin))
+    out.write("$upscope $end\n$enddefinitions $end\n")
+
+    # The gates are unknown until their first transition
+    origin = records[0][0]
+    out.write("#0\n$dumpvars\n")
+    for pin in pins:
+        out.write("x%s\n" % ids[pin])
+    out.write("b0 %s\n$end\n" % ids["D"])
+
+    state = {}
+    current = 0
+    for time, kind, value in records:
+        if time - origin != current:
+            current = time - origin
+            out.write("#%d\n" % current)
+        if kind in "ZS":
+            out.write("1%s\n" % ids[kind])
+        elif kind == "D":
+            out.write("b{:b} {}\n".format(value, ids["D"]))
+        else:
+            level = "1" if kind == "H" else "0"
+            for pin in pins:
+                if value >> pin & 1 and state.get(pin) != level:
+                    state[pin] = level
+                    out.write("%s%s\n" % (level, ids[pin]))
+
+
+if __name__ == "__main__":
+    main()
@@ -23,8 +23,11 @@
 /*
  * A minimal static circular queue.
  * It supports only insertion, and older values are automatically overwritten.
+ * The capacity N must be a power of 2, so the indexes wrap around through a bit mask.
  */
 template<typename T, int N> class CircularQueue {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "CircularQueue capacity must be a power of 2");
+
 public:
   /**
    * Construct a new Circular Queue object filling it with zeros or
@@ -38,8 +41,7 @@ public:
   T insert(T value) {
     T ret = arr[index];
     arr[index] = value;
-    index++;
-    if (index == N) { index = 0; }
+    index = (index + 1) & (N - 1);
     if (n < N) { n++; }
 
     return ret;
@@ -54,6 +56,13 @@ public:
     index = 0;
   }
 
+  /**
+   * Return the i-th stored element, starting from the oldest one.
+   */
+  T get(int i) const {
+    return arr[(index - n + i) & (N - 1)];
+  }
+
   /**
    * Return the number of stored elements.
    */
@@ -19,4 +19,18 @@
  ******************************************************************************/
 #include "dimmable_light.h"
 
-uint8_t DimmableLight::nLights = 0;
\ No newline at end of file
+thyristor_count_t DimmableLight::nLights = 0;
+
+void DimmableLight::setBrightnessAll(DimmableLight lights[], const uint8_t frame[],
+                                     thyristor_count_t n) {
+  if (n > N) { n = N; }
+
+  Thyristor *thyristors[N];
+  uint16_t delays[N];
+  for (thyristor_count_t i = 0; i < n; i++) {
+    lights[i].brightness = frame[i];
+    thyristors[i] = &lights[i].thyristor;
+    delays[i] = brightnessToDelay(frame[i]);
+  }
+  Thyristor::setDelays(thyristors, delays, n);
+}
@@ -44,17 +44,16 @@ public:
    */
   void setBrightness(uint8_t bri) {
     brightness = bri;
-#ifdef NETWORK_FREQ_FIXED_50HZ
-    uint16_t newDelay = 10000 - (uint16_t)(((uint32_t)bri * 10000) / 255);
-#elif defined(NETWORK_FREQ_FIXED_60HZ)
-    uint16_t newDelay = 8333 - (uint16_t)(((uint32_t)bri * 8333) / 255);
-#elif defined(NETWORK_FREQ_RUNTIME)
-    uint16_t newDelay =
-      Thyristor::getSemiPeriod() - (uint16_t)(((uint32_t)bri * Thyristor::getSemiPeriod()) / 255);
-#endif
-    thyristor.setDelay(newDelay);
+    thyristor.setDelay(brightnessToDelay(bri));
   };
 
+  /**
+   * Set the brightness of multiple lights at once: frame[i] is the brightness of lights[i].
+   * The new values are applied in the same semi-period, and it is cheaper than calling
+   * setBrightness(..) on each light.
+   */
+  static void setBrightnessAll(DimmableLight lights[], const uint8_t frame[], thyristor_count_t n);
+
   /**
    * Return the current brightness
    */
@@ -91,6 +90,10 @@ public:
     return Thyristor::getDetectedFrequency();
   }
 
+  static uint32_t getDetectedFrequencyMilliHz() {
+    return Thyristor::getDetectedFrequencyMilliHz();
+  }
+
   static bool isFrequencyMonitorAlwaysOn() {
     return Thyristor::isFrequencyMonitorAlwaysOn();
   }
@@ -133,16 +136,42 @@ public:
     Thyristor::setSyncPullup(pullup);
   }
 
+  /**
+   * Set the offset of the zero-cross signal w.r.t. the actual zero crossing of the voltage, in
+   * microseconds. See Thyristor::setZeroCrossOffset(..).
+   */
+  static void setZeroCrossOffset(int16_t offset) {
+    Thyristor::setZeroCrossOffset(offset);
+  }
+
+  static int16_t getZeroCrossOffset() {
+    return Thyristor::getZeroCrossOffset();
+  }
+
   /**
    * Return the number of instantiated lights.
    */
-  static uint8_t getLightNumber() {
+  static thyristor_count_t getLightNumber() {
     return nLights;
   };
 
 private:
-  static const uint8_t N = Thyristor::N;
-  static uint8_t nLights;
+  /**
+   * Convert the brightness to the delay of the thyristor.
+   */
+  static uint16_t brightnessToDelay(uint8_t bri) {
+#ifdef NETWORK_FREQ_FIXED_50HZ
+    return 10000 - (uint16_t)(((uint32_t)bri * 10000) / 255);
+#elif defined(NETWORK_FREQ_FIXED_60HZ)
+    return 8333 - (uint16_t)(((uint32_t)bri * 8333) / 255);
+#elif defined(NETWORK_FREQ_RUNTIME)
+    return Thyristor::getSemiPeriod()
+           - (uint16_t)(((uint32_t)bri * Thyristor::getSemiPeriod()) / 255);
+#endif
+  }
+
+  static const thyristor_count_t N = Thyristor::N;
+  static thyristor_count_t nLights;
 
   Thyristor thyristor;
 
@@ -46,35 +46,18 @@ public:
    * Set the brightness, 0 to turn off the lamp
    */
   void setBrightness(uint8_t bri) {
-#ifdef NETWORK_FREQ_FIXED_50HZ
-    double tempBrightness = -1.5034e-10 * pow(bri, 5) + 9.5843e-08 * pow(bri, 4)
-                            - 2.2953e-05 * pow(bri, 3) + 0.0025471 * pow(bri, 2) - 0.14965 * bri + 9.9846;
-#elif defined(NETWORK_FREQ_FIXED_60HZ)
-    double tempBrightness = -1.2528e-10 * pow(bri, 5) + 7.9866e-08 * pow(bri, 4)
-                            - 1.9126e-05 * pow(bri, 3) + 0.0021225 * pow(bri, 2) - 0.12471 * bri + 8.3201;
-#elif defined(NETWORK_FREQ_RUNTIME)
-    double tempBrightness;
-    if (Thyristor::getFrequency() == 50) {
-      tempBrightness = -1.5034e-10 * pow(bri, 5) + 9.5843e-08 * pow(bri, 4)
-                       - 2.2953e-05 * pow(bri, 3) + 0.0025471 * pow(bri, 2) - 0.14965 * bri + 9.9846;
-    } else if (Thyristor::getFrequency() == 60) {
-      tempBrightness = -1.2528e-10 * pow(bri, 5) + 7.9866e-08 * pow(bri, 4)
-                       - 1.9126e-05 * pow(bri, 3) + 0.0021225 * pow(bri, 2) - 0.12471 * bri + 8.3201;
-    } else {
-      // Only on and off
-      if (bri > 0) {
-        thyristor.turnOn();
-      } else {
-        thyristor.turnOff();
-      }
-      return;
-    }
-#endif
-    tempBrightness *= 1000;
-
-    thyristor.setDelay(tempBrightness);
+    brightness = bri;
+    thyristor.setDelay(brightnessToDelay(bri));
   };
 
+  /**
+   * Set the brightness of multiple lights at once: frame[i] is the brightness of lights[i].
+   * The new values are applied in the same semi-period, and it is cheaper than calling
+   * setBrightness(..) on each light.
+   */
+  static void setBrightnessAll(DimmableLightLinearized lights[], const uint8_t frame[],
+                               thyristor_count_t n);
+
   /**
    * Return the current brightness.
    */
@@ -104,6 +87,10 @@ public:
     return Thyristor::getDetectedFrequency();
   }
 
+  static uint32_t getDetectedFrequencyMilliHz() {
+    return Thyristor::getDetectedFrequencyMilliHz();
+  }
+
   static bool isFrequencyMonitorAlwaysOn() {
     return Thyristor::isFrequencyMonitorAlwaysOn();
   }
@@ -146,16 +133,56 @@ public:
     Thyristor::setSyncPullup(pullup);
   }
 
+  /**
+   * Set the offset of the zero-cross signal w.r.t. the actual zero crossing of the voltage, in
+   * microseconds. See Thyristor::setZeroCrossOffset(..).
+   */
+  static void setZeroCrossOffset(int16_t offset) {
+    Thyristor::setZeroCrossOffset(offset);
+  }
+
+  static int16_t getZeroCrossOffset() {
+    return Thyristor::getZeroCrossOffset();
+  }
+
   /**
    * Return the number of instantiated lights.
    */
-  static uint8_t getLightNumber() {
+  static thyristor_count_t getLightNumber() {
     return nLights;
   };
 
 private:
-  static const uint8_t N = 8;
-  static uint8_t nLights;
+  /**
+   * Convert the brightness to the delay of the thyristor.
+   */
+  static uint16_t brightnessToDelay(uint8_t bri) {
+#ifdef NETWORK_FREQ_FIXED_50HZ
+    double tempBrightness = -1.5034e-10 * pow(bri, 5) + 9.5843e-08 * pow(bri, 4)
+                            - 2.2953e-05 * pow(bri, 3) + 0.0025471 * pow(bri, 2) - 0.14965 * bri + 9.9846;
+#elif defined(NETWORK_FREQ_FIXED_60HZ)
+    double tempBrightness = -1.2528e-10 * pow(bri, 5) + 7.9866e-08 * pow(bri, 4)
+                            - 1.9126e-05 * pow(bri, 3) + 0.0021225 * pow(bri, 2) - 0.12471 * bri + 8.3201;
+#elif defined(NETWORK_FREQ_RUNTIME)
+    double tempBrightness;
+    if (Thyristor::getFrequency() == 50) {
+      tempBrightness = -1.5034e-10 * pow(bri, 5) + 9.5843e-08 * pow(bri, 4)
+                       - 2.2953e-05 * pow(bri, 3) + 0.0025471 * pow(bri, 2) - 0.14965 * bri + 9.9846;
+    } else if (Thyristor::getFrequency() == 60) {
+      tempBrightness = -1.2528e-10 * pow(bri, 5) + 7.9866e-08 * pow(bri, 4)
+                       - 1.9126e-05 * pow(bri, 3) + 0.0021225 * pow(bri, 2) - 0.12471 * bri + 8.3201;
+    } else {
+      // Only on and off
+      return bri > 0 ? 0 : Thyristor::getSemiPeriod();
+    }
+#endif
+    tempBrightness *= 1000;
+
+    return tempBrightness;
+  }
+
+  static const thyristor_count_t N = Thyristor::N;
+  static thyristor_count_t nLights;
 
   Thyristor thyristor;
 
@@ -21,7 +21,8 @@
 
 bool DimmableLightManager::add(String lightName, uint8_t pin) {
   const char* temp = lightName.c_str();
-#if defined(ESP8266) || defined(ESP32) || defined(ARDUINO_ARCH_SAMD) || defined(ARDUINO_ARCH_RP2040)
+#if defined(ESP8266) || defined(ESP32) || defined(ARDUINO_ARCH_SAMD)                              \
+  || defined(ARDUINO_ARCH_RP2040) || defined(ARDUINO_ARCH_NATIVE)
   std::unordered_map<std::string, DimmableLight*>::const_iterator it = dla.find(temp);
 #elif defined(AVR)
   std::map<std::string, DimmableLight*>::const_iterator it = dla.find(temp);
@@ -37,7 +38,8 @@ bool DimmableLightManager::add(String lightName, uint8_t pin) {
 
 DimmableLight* DimmableLightManager::get(String lightName) {
   const char* temp = lightName.c_str();
-#if defined(ESP8266) || defined(ESP32) || defined(ARDUINO_ARCH_SAMD) || defined(ARDUINO_ARCH_RP2040)
+#if defined(ESP8266) || defined(ESP32) || defined(ARDUINO_ARCH_SAMD)                              \
+  || defined(ARDUINO_ARCH_RP2040) || defined(ARDUINO_ARCH_NATIVE)
   std::unordered_map<std::string, DimmableLight*>::const_iterator it = dla.find(temp);
 #elif defined(AVR)
   std::map<std::string, DimmableLight*>::const_iterator it = dla.find(temp);
@@ -50,7 +52,8 @@ DimmableLight* DimmableLightManager::get(String lightName) {
 }
 
 std::pair<String, DimmableLight*> DimmableLightManager::get() {
-#if defined(ESP8266) || defined(ESP32) || defined(ARDUINO_ARCH_SAMD) || defined(ARDUINO_ARCH_RP2040)
+#if defined(ESP8266) || defined(ESP32) || defined(ARDUINO_ARCH_SAMD)                              \
+  || defined(ARDUINO_ARCH_RP2040) || defined(ARDUINO_ARCH_NATIVE)
   static std::unordered_map<std::string, DimmableLight*>::const_iterator it = dla.begin();
 #elif defined(AVR)
   static std::map<std::string, DimmableLight*>::const_iterator it = dla.begin();
@@ -0,0 +1,202 @@
+/******************************************************************************
+ *  This file is part of Dimmable Light for Arduino, a library to control     *
+ *  dimmers.                                                                  *
+ *                                                                            *
+ *  Copyright (C) 2018-2023  Fabiano Riccardi                                 *
+ *                                                                            *
+ *  Dimmable Light for Arduino is free software; you can redistribute         *
+ *  it and/or modify it under the terms of the GNU Lesser General Public      *
+ *  License as published by the Free Software Foundation; either              *
+ *  version 2.1 of the License, or (at your option) any later version.        *
+ *                                                                            *
+ *  This library is distributed in the hope that it will be useful,           *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU          *
+ *  Lesser General Public License for more details.                           *
+ *                                                                            *
+ *  You should have received a copy of the GNU Lesser General Public License  *
+ *  along with this library; if not, see <http://www.gnu.org/licenses/>.      *
+ ******************************************************************************/
+#ifndef FAST_GPIO_H
+#define FAST_GPIO_H
+
+#include <Arduino.h>
+
+// These functions are called by ISRs, so they must be always inlined (on ESP8266 and ESP32 the ISRs
+// cannot call functions stored in flash).
+#define FAST_GPIO_INLINE static inline __attribute__((always_inline))
+
+/***********************************************************************************
+ * Minimalistic "HAL" to drive the gate pins from the ISRs writing directly the GPIO
+ * registers, since digitalWrite(..) is too slow on some platforms (e.g. on AVR it takes
+ * about 5us). Pins are identified by a port and a mask, so the pins on the same port
+ * can be set or cleared with a single write.
+ ***********************************************************************************/
+
+#if defined(ARDUINO_ARCH_ESP8266)
+
+// Port 0 is for GPIO0-15, port 1 for GPIO16 (it is managed by the RTC module)
+typedef uint8_t gpio_port_t;
+typedef uint16_t gpio_mask_t;
+
+static inline gpio_port_t gpioPort(uint8_t pin) {
+  return pin < 16 ? 0 : 1;
+}
+
+static inline gpio_mask_t gpioMask(uint8_t pin) {
+  return pin < 16 ? 1 << pin : 1;
+}
+
+FAST_GPIO_INLINE void gpioSet(gpio_port_t port, gpio_mask_t mask) {
+  if (port == 0) {
+    GPOS = mask;
+  } else {
+    GP16O |= mask;
+  }
+}
+
+FAST_GPIO_INLINE void gpioClear(gpio_port_t port, gpio_mask_t mask) {
+  if (port == 0) {
+    GPOC = mask;
+  } else {
+    GP16O &= ~mask;
+  }
+}
+
+#elif defined(ARDUINO_ARCH_ESP32)
+
+#include <soc/soc.h>
+#include <soc/gpio_reg.h>
+
+// Port 0 is for GPIO0-31, port 1 for GPIO32-39 (if present)
+typedef uint8_t gpio_port_t;
+typedef uint32_t gpio_mask_t;
+
+static inline gpio_port_t gpioPort(uint8_t pin) {
+  return pin < 32 ? 0 : 1;
+}
+
+static inline gpio_mask_t gpioMask(uint8_t pin) {
+  return (gpio_mask_t)1 << (pin & 31);
+}
+
+FAST_GPIO_INLINE void gpioSet(gpio_port_t port, gpio_mask_t mask) {
+#ifdef GPIO_OUT1_W1TS_REG
+  if (port != 0) {
+    REG_WRITE(GPIO_OUT1_W1TS_REG, mask);
+    return;
+  }
+#endif
+  REG_WRITE(GPIO_OUT_W1TS_REG, mask);
+}
+
+FAST_GPIO_INLINE void gpioClear(gpio_port_t port, gpio_mask_t mask) {
+#ifdef GPIO_OUT1_W1TC_REG
+  if (port != 0) {
+    REG_WRITE(GPIO_OUT1_W1TC_REG, mask);
+    return;
+  }
+#endif
+  REG_WRITE(GPIO_OUT_W1TC_REG, mask);
+}
+
+#elif defined(ARDUINO_ARCH_AVR)
+
+// The port is the address of PORTx register
+typedef volatile uint8_t *gpio_port_t;
+typedef uint8_t gpio_mask_t;
+
+static inline gpio_port_t gpioPort(uint8_t pin) {
+  return portOutputRegister(digitalPinToPort(pin));
+}
+
+static inline gpio_mask_t gpioMask(uint8_t pin) {
+  return digitalPinToBitMask(pin);
+}
+
+// These read-modify-write operations are safe since they are executed with interrupts disabled,
+// and digitalWrite(..) disables the interrupts as well.
+FAST_GPIO_INLINE void gpioSet(gpio_port_t port, gpio_mask_t mask) {
+  *port |= mask;
+}
+
+FAST_GPIO_INLINE void gpioClear(gpio_port_t port, gpio_mask_t mask) {
+  *port &= ~mask;
+}
+
+#elif defined(ARDUINO_ARCH_SAMD)
+
+// The port is the address of the port group
+typedef PortGroup *gpio_port_t;
+typedef uint32_t gpio_mask_t;
+
+static inline gpio_port_t gpioPort(uint8_t pin) {
+  return &PORT->Group[g_APinDescription[pin].ulPort];
+}
+
+static inline gpio_mask_t gpioMask(uint8_t pin) {
+  return (gpio_mask_t)1 << g_APinDescription[pin].ulPin;
+}
+
+FAST_GPIO_INLINE void gpioSet(gpio_port_t port, gpio_mask_t mask) {
+  port->OUTSET.reg = mask;
+}
+
+FAST_GPIO_INLINE void gpioClear(gpio_port_t port, gpio_mask_t mask) {
+  port->OUTCLR.reg = mask;
+}
+
+#elif defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)
+
+#include <hardware/structs/sio.h>
+
+// RP2040 has a single bank of GPIOs controlled by SIO
+typedef uint8_t gpio_port_t;
+typedef uint32_t gpio_mask_t;
+
+static inline gpio_port_t gpioPort(uint8_t) {
+  return 0;
+}
+
+static inline gpio_mask_t gpioMask(uint8_t pin) {
+  return (gpio_mask_t)1 << pin;
+}
+
+FAST_GPIO_INLINE void gpioSet(gpio_port_t, gpio_mask_t mask) {
+  sio_hw->gpio_set = mask;
+}
+
+FAST_GPIO_INLINE void gpioClear(gpio_port_t, gpio_mask_t mask) {
+  sio_hw->gpio_clr = mask;
+}
+
+#elif defined(ARDUINO_ARCH_NATIVE)
+
+// The simulator (see extras/native) has a single bank of 64 GPIOs
+typedef uint8_t gpio_port_t;
+typedef uint64_t gpio_mask_t;
+
+/**
+ * Drive the pins of the mask to the given level. It is provided by the simulator.
+ */
+void nativeGpioWrite(uint64_t mask, uint8_t level);
+
+static inline gpio_port_t gpioPort(uint8_t) {
+  return 0;
+}
+
+static inline gpio_mask_t gpioMask(uint8_t pin) {
+  return (gpio_mask_t)1 << (pin & 63);
+}
+
+FAST_GPIO_INLINE void gpioSet(gpio_port_t, gpio_mask_t mask) {
+  nativeGpioWrite(mask, HIGH);
+}
+
+FAST_GPIO_INLINE void gpioClear(gpio_port_t, gpio_mask_t mask) {
+  nativeGpioWrite(mask, LOW);
+}
+
+#endif
+
+#endif  // END FAST_GPIO_H
@@ -0,0 +1,181 @@
+/******************************************************************************
+ *  This file is part of Dimmable Light for Arduino, a library to control     *
+ *  dimmers.                                                                  *
+ *                                                                            *
+ *  Copyright (C) 2018-2023  Fabiano Riccardi                                 *
+ *                                                                            *
+ *  Dimmable Light for Arduino is free software; you can redistribute         *
+ *  it and/or modify it under the terms of the GNU Lesser General Public      *
+ *  License as published by the Free Software Foundation; either              *
+ *  version 2.1 of the License, or (at your option) any later version.        *
+ *                                                                            *
+ *  This library is distributed in the hope that it will be useful,           *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU          *
+ *  Lesser General Public License for more details.                           *
+ *                                                                            *
+ *  You should have received a copy of the GNU Lesser General Public License  *
+ *  along with this library; if not, see <http://www.gnu.org/licenses/>.      *
+ ******************************************************************************/
+#ifdef ESP32
+
+#include "hw_mcpwm_esp32.h"
+#include <Arduino.h>
+
+#if defined(CONFIG_IDF_TARGET_ESP32) || defined(CONFIG_IDF_TARGET_ESP32S3)
+#include <driver/mcpwm.h>
+#include <esp_idf_version.h>
+
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(4, 4, 0)
+#error "MCPWM gates require ESP-IDF 4.4 or later (i.e. ESP32 Arduino core 2.0.x)"
+#endif
+
+// 2 units, with 3 timers each, with 2 generators each
+static const uint8_t nGates = 12;
+
+static int8_t gatePins[nGates] = { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+static uint16_t gateFirings[nGates];
+static bool timerReady[2][3];
+
+static bool begun = false;
+
+/**
+ * The sync input loads the counter with the phase, so the timer wraps at the gate-off. The phase is
+ * set in permille of the period.
+ */
+static uint16_t semiPeriod = 10000;
+static uint16_t phasePermille = 30;
+static uint16_t phase = 300;
+
+static inline mcpwm_unit_t unitOf(int8_t gate) {
+  return gate < 6 ? MCPWM_UNIT_0 : MCPWM_UNIT_1;
+}
+
+static inline mcpwm_timer_t timerOf(int8_t gate) {
+  return (mcpwm_timer_t)(gate % 6 / 2);
+}
+
+static inline mcpwm_generator_t generatorOf(int8_t gate) {
+  return gate % 2 ? MCPWM_GEN_B : MCPWM_GEN_A;
+}
+
+/**
+ * Synchronize the timer to the zero-cross edges, with the current phase.
+ */
+static void syncTimer(mcpwm_unit_t unit, mcpwm_timer_t timer) {
+  mcpwm_sync_config_t sync = {};
+  sync.sync_sig = MCPWM_SELECT_GPIO_SYNC0;
+  sync.timer_val = phasePermille;
+  sync.count_direction = MCPWM_TIMER_DIRECTION_UP;
+  mcpwm_sync_configure(unit, timer, &sync);
+}
+
+/**
+ * Start the timer, with both gates low. In MCPWM_DUTY_MODE_1, a generator goes low when the timer
+ * wraps and high on the compare match.
+ */
+static void startTimer(mcpwm_unit_t unit, mcpwm_timer_t timer) {
+  mcpwm_config_t config = {};
+  config.frequency = 1000000 / semiPeriod;
+  config.cmpr_a = 0;
+  config.cmpr_b = 0;
+  config.counter_mode = MCPWM_UP_COUNTER;
+  config.duty_mode = MCPWM_DUTY_MODE_1;
+  mcpwm_init(unit, timer, &config);
+  mcpwm_set_signal_low(unit, timer, MCPWM_GEN_A);
+  mcpwm_set_signal_low(unit, timer, MCPWM_GEN_B);
+  syncTimer(unit, timer);
+}
+
+void mcpwmGatesBegin(uint8_t syncPin, bool rising) {
+  for (mcpwm_unit_t unit : { MCPWM_UNIT_0, MCPWM_UNIT_1 }) {
+    mcpwm_gpio_init(unit, MCPWM_SYNC_0, syncPin);
+    mcpwm_sync_invert_gpio_synchro(unit, MCPWM_SELECT_GPIO_SYNC0, !rising);
+  }
+  begun = true;
+}
+
+int8_t mcpwmGatesAttach(uint8_t pin) {
+  int8_t free = -1;
+  for (int8_t gate = 0; gate < nGates; gate++) {
+    if (gatePins[gate] == pin) { return gate; }
+    if (free < 0 && gatePins[gate] < 0) { free = gate; }
+  }
+  if (!begun || free < 0) { return -1; }
+
+  const mcpwm_unit_t unit = unitOf(free);
+  const mcpwm_timer_t timer = timerOf(free);
+  if (!timerReady[unit][timer]) {
+    startTimer(unit, timer);
+    timerReady[unit][timer] = true;
+  }
+  mcpwm_gpio_init(unit, (mcpwm_io_signals_t)(MCPWM0A + 2 * timer + free % 2), pin);
+  gatePins[free] = pin;
+  gateFirings[free] = MCPWM_GATE_ALWAYS_OFF;
+  return free;
+}
+
+void mcpwmGatesSetTiming(uint16_t newSemiPeriod, uint16_t gateOff) {
+  const uint16_t newPhasePermille =
+    ((uint32_t)(newSemiPeriod - gateOff) * 1000 + newSemiPeriod / 2) / newSemiPeriod;
+  if (newSemiPeriod == semiPeriod && newPhasePermille == phasePermille) { return; }
+
+  semiPeriod = newSemiPeriod;
+  phasePermille = newPhasePermille;
+  phase = (uint32_t)phasePermille * semiPeriod / 1000;
+  for (mcpwm_unit_t unit : { MCPWM_UNIT_0, MCPWM_UNIT_1 }) {
+    for (mcpwm_timer_t timer : { MCPWM_TIMER_0, MCPWM_TIMER_1, MCPWM_TIMER_2 }) {
+      if (!timerReady[unit][timer]) { continue; }
+      mcpwm_set_frequency(unit, timer, 1000000 / semiPeriod);
+      syncTimer(unit, timer);
+    }
+  }
+
+  // The compare values depend on the phase
+  for (int8_t gate = 0; gate < nGates; gate++) {
+    const uint16_t firing = gateFirings[gate];
+    gateFirings[gate] = MCPWM_GATE_ALWAYS_OFF;
+    if (gatePins[gate] >= 0) { mcpwmGatesFire(gate, firing); }
+  }
+}
+
+void mcpwmGatesFire(int8_t gate, uint16_t micros) {
+  const uint16_t previous = gateFirings[gate];
+  if (micros == previous) { return; }
+  gateFirings[gate] = micros;
+
+  const mcpwm_unit_t unit = unitOf(gate);
+  const mcpwm_timer_t timer = timerOf(gate);
+  const mcpwm_generator_t generator = generatorOf(gate);
+  if (micros == MCPWM_GATE_ALWAYS_ON) {
+    mcpwm_set_signal_high(unit, timer, generator);
+  } else if (micros == MCPWM_GATE_ALWAYS_OFF) {
+    mcpwm_set_signal_low(unit, timer, generator);
+  } else {
+    // The compare value is applied when the timer wraps, i.e. at the gate-off, so the current
+    // semi-period is not affected. The match doesn't happen if the sync loads the counter with the
+    // compare value, hence the firing is at least 1 microsecond after the edge.
+    uint32_t duty = phase + (micros ? micros : 1);
+    if (duty >= semiPeriod) { duty = semiPeriod - 1; }
+    mcpwm_set_duty_in_us(unit, timer, generator, duty);
+    if (previous == MCPWM_GATE_ALWAYS_ON || previous == MCPWM_GATE_ALWAYS_OFF) {
+      mcpwm_set_duty_type(unit, timer, generator, MCPWM_DUTY_MODE_1);
+    }
+  }
+}
+
+#else
+
+void mcpwmGatesBegin(uint8_t, bool) {}
+
+int8_t mcpwmGatesAttach(uint8_t) {
+  return -1;
+}
+
+void mcpwmGatesSetTiming(uint16_t, uint16_t) {}
+
+void mcpwmGatesFire(int8_t, uint16_t) {}
+
+#endif  // END CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S3
+
+#endif  // END ESP32
@@ -0,0 +1,66 @@
+/******************************************************************************
+ *  This file is part of Dimmable Light for Arduino, a library to control     *
+ *  dimmers.                                                                  *
+ *                                                                            *
+ *  Copyright (C) 2018-2023  Fabiano Riccardi                                 *
+ *                                                                            *
+ *  Dimmable Light for Arduino is free software; you can redistribute         *
+ *  it and/or modify it under the terms of the GNU Lesser General Public      *
+ *  License as published by the Free Software Foundation; either              *
+ *  version 2.1 of the License, or (at your option) any later version.        *
+ *                                                                            *
+ *  This library is distributed in the hope that it will be useful,           *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU          *
+ *  Lesser General Public License for more details.                           *
+ *                                                                            *
+ *  You should have received a copy of the GNU Lesser General Public License  *
+ *  along with this library; if not, see <http://www.gnu.org/licenses/>.      *
+ ******************************************************************************/
+
+/***********************************************************************************
+ * Gates fired by the MCPWM generators of ESP32 (see MCPWM_GATES in thyristor.cpp).
+ * Each MCPWM timer is reset by the zero-cross edge through the sync input, and its
+ * period is the semi-period: a generator raises its gate on the compare match and
+ * lowers it when the timer wraps, at the gate-off time. Then the firing is timed by
+ * hardware, the software only updates the compare values.
+ ***********************************************************************************/
+#ifdef ESP32
+
+#ifndef HW_MCPWM_ESP32_H
+#define HW_MCPWM_ESP32_H
+
+#include <stdint.h>
+
+/**
+ * Special firing times, see mcpwmGatesFire(..).
+ */
+#define MCPWM_GATE_ALWAYS_ON  0xFFFE
+#define MCPWM_GATE_ALWAYS_OFF 0xFFFF
+
+/**
+ * Route the sync pin to the MCPWM units. Before, no gate can be attached.
+ */
+void mcpwmGatesBegin(uint8_t syncPin, bool rising);
+
+/**
+ * Return the generator driving the pin, attaching a free one the first time. Return -1 if none is
+ * free (at most 12 on ESP32 and ESP32-S3, none on the other variants) or if mcpwmGatesBegin(..)
+ * was not called. The gate is kept low until mcpwmGatesFire(..).
+ */
+int8_t mcpwmGatesAttach(uint8_t pin);
+
+/**
+ * Set the semi-period and the time of the gate-off from the zero-cross edge, in microseconds.
+ */
+void mcpwmGatesSetTiming(uint16_t semiPeriod, uint16_t gateOff);
+
+/**
+ * Fire the gate at the given microseconds from the zero-cross edge, from the next semi-period. It
+ * can be also MCPWM_GATE_ALWAYS_ON or MCPWM_GATE_ALWAYS_OFF.
+ */
+void mcpwmGatesFire(int8_t gate, uint16_t micros);
+
+#endif  // END HW_MCPWM_ESP32_H
+
+#endif  // END ESP32
@@ -0,0 +1,251 @@
+/******************************************************************************
+ *  This file is part of Dimmable Light for Arduino, a library to control     *
+ *  dimmers.                                                                  *
+ *                                                                            *
+ *  Copyright (C) 2018-2023  Fabiano Riccardi                                 *
+ *                                                                            *
+ *  Dimmable Light for Arduino is free software; you can redistribute         *
+ *  it and/or modify it under the terms of the GNU Lesser General Public      *
+ *  License as published by the Free Software Foundation; either              *
+ *  version 2.1 of the License, or (at your option) any later version.        *
+ *                                                                            *
+ *  This library is distributed in the hope that it will be useful,           *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU          *
+ *  Lesser General Public License for more details.                           *
+ *                                                                            *
+ *  You should have received a copy of the GNU Lesser General Public License  *
+ *  along with this library; if not, see <http://www.gnu.org/licenses/>.      *
+ ******************************************************************************/
+#if defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)
+
+#include "hw_pio_pico.h"
+#include <Arduino.h>
+#include <hardware/clocks.h>
+#include <hardware/dma.h>
+#include <hardware/pio.h>
+
+/**
+ * The program, its addresses are relative to the start:
+ *
+ *   .wrap_target
+ *   0: wait !edge gpio sync
+ *   1: wait edge gpio sync
+ *   2: out y, 32            ; number of steps - 1
+ *   step:
+ *   3: out x, 32            ; cycles to wait - 4
+ *   delay:
+ *   4: jmp x-- delay
+ *   5: out pins, 32         ; levels of the gates
+ *   6: jmp y-- step
+ *   .wrap
+ *
+ * Both from the edge and from the previous step, a step takes x + 4 cycles. The OSR is refilled by
+ * autopull, so the table is: steps - 1, then cycles and levels of each step.
+ */
+static const uint8_t programLength = 7;
+static const uint8_t stepOverhead = 4;
+static uint16_t instructions[programLength];
+static struct pio_program program;
+
+static const uint16_t tableLength = 1 + 2 * PIO_ENGINE_STEPS;
+
+/**
+ * Triple buffer of tables, each one followed by a padding word, so the read address of the DMA
+ * just after the end of a table doesn't point to the next one. At any time, a table may be read
+ * by the DMA, one may be pending (i.e. read at the next loop), and the other one is free.
+ */
+static uint32_t tables[3][tableLength + 1];
+
+/**
+ * Table read by the DMA at the next loop. It is the source of the control channel.
+ */
+static uint32_t *volatile pending = tables[0];
+
+static PIO pio = nullptr;
+static int sm = -1;
+static uint offset = 0;
+static int dataChannel = -1;
+static int controlChannel = -1;
+
+static uint8_t syncPin = 0;
+static bool syncRising = true;
+static bool running = false;
+
+/**
+ * Bitmask of the gates, and their span of OUT pins: the levels of the tables are relative to the
+ * first one.
+ */
+static uint32_t gates = 0;
+static uint8_t outBase = 0;
+static uint8_t outCount = 0;
+
+/**
+ * Return the table containing the given address, including its padding word, -1 if none.
+ */
+static int tableOf(uintptr_t address) {
+  for (int i = 0; i < 3; i++) {
+    if (address >= (uintptr_t)tables[i] && address <= (uintptr_t)&tables[i][tableLength]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Release the resources claimed so far.
+ */
+static void release() {
+  if (controlChannel >= 0) {
+    dma_channel_unclaim(controlChannel);
+    controlChannel = -1;
+  }
+  if (dataChannel >= 0) {
+    dma_channel_unclaim(dataChannel);
+    dataChannel = -1;
+  }
+  if (sm >= 0) {
+    pio_remove_program(pio, &program, offset);
+    pio_sm_unclaim(pio, sm);
+    sm = -1;
+  }
+  pio = nullptr;
+}
+
+bool pioEngineStart(uint8_t pin, bool rising) {
+  if (running) { return true; }
+  syncPin = pin;
+  syncRising = rising;
+
+  instructions[0] = pio_encode_wait_gpio(!rising, pin);
+  instructions[1] = pio_encode_wait_gpio(rising, pin);
+  instructions[2] = pio_encode_out(pio_y, 32);
+  instructions[3] = pio_encode_out(pio_x, 32);
+  instructions[4] = pio_encode_jmp_x_dec(4);
+  instructions[5] = pio_encode_out(pio_pins, 32);
+  instructions[6] = pio_encode_jmp_y_dec(3);
+  program.instructions = instructions;
+  program.length = programLength;
+  program.origin = -1;
+
+  // Take the first PIO with a free state machine and room for the program
+  PIO candidates[] = { pio0, pio1 };
+  for (PIO candidate : candidates) {
+    if (!pio_can_add_program(candidate, &program)) { continue; }
+    sm = pio_claim_unused_sm(candidate, false);
+    if (sm >= 0) {
+      pio = candidate;
+      offset = pio_add_program(pio, &program);
+      break;
+    }
+  }
+  dataChannel = dma_claim_unused_channel(false);
+  controlChannel = dma_claim_unused_channel(false);
+  if (sm < 0 || dataChannel < 0 || controlChannel < 0) {
+    release();
+    return false;
+  }
+
+  // The other GPIOs in the span of OUT pins are not affected, unless they are driven by the same
+  // PIO
+  for (uint8_t i = outBase; i < outBase + outCount; i++) {
+    if (gates & (1ul << i)) { pio_gpio_init(pio, i); }
+  }
+  pio_sm_set_consecutive_pindirs(pio, sm, outBase, outCount, true);
+
+  pio_sm_config c = pio_get_default_sm_config();
+  sm_config_set_wrap(&c, offset, offset + programLength - 1);
+  sm_config_set_out_pins(&c, outBase, outCount);
+  sm_config_set_out_shift(&c, true, true, 32);
+  sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_TX);
+  pio_sm_init(pio, sm, offset, &c);
+
+  // The data channel feeds a table to the state machine, then the control channel restarts it
+  // from the pending table
+  dma_channel_config data = dma_channel_get_default_config(dataChannel);
+  channel_config_set_transfer_data_size(&data, DMA_SIZE_32);
+  channel_config_set_read_increment(&data, true);
+  channel_config_set_write_increment(&data, false);
+  channel_config_set_dreq(&data, pio_get_dreq(pio, sm, true));
+  channel_config_set_chain_to(&data, controlChannel);
+  dma_channel_configure(dataChannel, &data, &pio->txf[sm], pending, tableLength, false);
+
+  dma_channel_config control = dma_channel_get_default_config(controlChannel);
+  channel_config_set_transfer_data_size(&control, DMA_SIZE_32);
+  channel_config_set_read_increment(&control, false);
+  channel_config_set_write_increment(&control, false);
+  dma_channel_configure(controlChannel, &control, &dma_hw->ch[dataChannel].al3_read_addr_trig,
+                        &pending, 1, false);
+
+  dma_channel_start(controlChannel);
+  pio_sm_set_enabled(pio, sm, true);
+  running = true;
+  return true;
+}
+
+void pioEngineStop() {
+  if (!running) { return; }
+  running = false;
+
+  // Break the loop before aborting, so the control channel cannot restart the data one
+  dma_channel_config data = dma_get_channel_config(dataChannel);
+  channel_config_set_chain_to(&data, dataChannel);
+  dma_channel_set_config(dataChannel, &data, false);
+  dma_channel_abort(controlChannel);
+  dma_channel_abort(dataChannel);
+
+  pio_sm_set_enabled(pio, sm, false);
+  pio_sm_clear_fifos(pio, sm);
+
+  // The GPIOs keep the levels, since the SIO drives them as the state machine did
+  uint32_t levels = gpio_get_all();
+  for (uint8_t i = 0; i < 32; i++) {
+    if (gates & (1ul << i)) {
+      gpio_put(i, levels & (1ul << i));
+      gpio_set_function(i, GPIO_FUNC_SIO);
+    }
+  }
+  release();
+}
+
+void pioEngineLoad(const struct PioStep steps[], uint32_t newGates) {
+  // The pins are mapped when the engine starts, so it is restarted with the new table
+  const bool restart = running && newGates != gates;
+  if (restart) { pioEngineStop(); }
+  if (newGates != gates) {
+    gates = newGates;
+    outBase = 0;
+    outCount = 0;
+    if (gates) {
+      while (!(gates & (1ul << outBase))) { outBase++; }
+      outCount = 32 - outBase;
+      while (!(gates & (1ul << (outBase + outCount - 1)))) { outCount--; }
+    }
+  }
+
+  // Take the table neither read by the DMA nor pending
+  int busy = running ? tableOf(dma_channel_hw_addr(dataChannel)->read_addr) : -1;
+  int next = 0;
+  while (next == busy || tables[next] == pending) { next++; }
+
+  // Convert the times into the cycles from the previous step, postponing the steps too close
+  uint32_t *table = tables[next];
+  const uint32_t cyclesPerMicro = clock_get_hz(clk_sys) / 1000000;
+  uint32_t previous = 0;
+  table[0] = PIO_ENGINE_STEPS - 1;
+  for (uint8_t i = 0; i < PIO_ENGINE_STEPS; i++) {
+    uint32_t time = steps[i].micros * cyclesPerMicro;
+    if (time < previous + stepOverhead) { time = previous + stepOverhead; }
+    table[1 + 2 * i] = time - previous - stepOverhead;
+    table[2 + 2 * i] = (steps[i].levels & gates) >> outBase;
+    previous = time;
+  }
+
+  // The table must be written before the DMA can read it
+  __asm__ __volatile__("" ::: "memory");
+  pending = table;
+
+  if (restart) { pioEngineStart(syncPin, syncRising); }
+}
+
+#endif  // END ARDUINO_ARCH_RP2040
@@ -0,0 +1,74 @@
+/******************************************************************************
+ *  This file is part of Dimmable Light for Arduino, a library to control     *
+ *  dimmers.                                                                  *
+ *                                                                            *
+ *  Copyright (C) 2018-2023  Fabiano Riccardi                                 *
+ *                                                                            *
+ *  Dimmable Light for Arduino is free software; you can redistribute         *
+ *  it and/or modify it under the terms of the GNU Lesser General Public      *
+ *  License as published by the Free Software Foundation; either              *
+ *  version 2.1 of the License, or (at your option) any later version.        *
+ *                                                                            *
+ *  This library is distributed in the hope that it will be useful,           *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU          *
+ *  Lesser General Public License for more details.                           *
+ *                                                                            *
+ *  You should have received a copy of the GNU Lesser General Public License  *
+ *  along with this library; if not, see <http://www.gnu.org/licenses/>.      *
+ ******************************************************************************/
+
+/***********************************************************************************
+ * Phase-control engine running on a PIO state machine of RP2040 (see PIO_ENGINE in
+ * thyristor.cpp). The state machine waits for the zero-cross edge, then walks
+ * through a table of steps, each one setting the level of all the gates after a
+ * number of CPU cycles. A DMA channel feeds the table in loop, so the CPU writes a
+ * new table only when the schedule changes.
+ ***********************************************************************************/
+#if defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)
+
+#ifndef HW_PIO_PICO_H
+#define HW_PIO_PICO_H
+
+#include "thyristor.h"
+#include <stdint.h>
+
+/**
+ * Steps per semi-period: the gates always on, one per thyristor, and the gate-off.
+ */
+#define PIO_ENGINE_STEPS (MAX_THYRISTORS + 2)
+
+/**
+ * Levels of the gates from the given microseconds after the zero-cross edge. The steps must be
+ * sorted by time, the ones closer than 4 CPU cycles are postponed.
+ */
+struct PioStep {
+  uint16_t micros;
+
+  /**
+   * Bitmask of the GPIOs driven high, among the gates.
+   */
+  uint32_t levels;
+};
+
+/**
+ * Claim a state machine and 2 DMA channels, and start firing the gates at the edges of the sync
+ * pin with the steps of the last pioEngineLoad(..). Return false if the resources are not
+ * available.
+ */
+bool pioEngineStart(uint8_t syncPin, bool rising);
+
+/**
+ * Stop the engine and give the gates back to the GPIO functions, in the current state.
+ */
+void pioEngineStop();
+
+/**
+ * Set the steps of the following semi-periods, PIO_ENGINE_STEPS are read. The gates are the
+ * bitmask of the GPIOs driven by the engine: if they change, the engine is restarted.
+ */
+void pioEngineLoad(const struct PioStep steps[], uint32_t gates);
+
+#endif  // HW_PIO_PICO_H
+
+#endif  // ARDUINO_ARCH_RP2040
@@ -62,15 +62,85 @@
 #define OCRxAL(X)              _OCRxAL(X)
 #define _OCRxA(X)              OCR##X##A
 #define OCRxA(X)               _OCRxA(X)
+#define _TIFRx(X)              TIFR##X
+#define TIFRx(X)               _TIFRx(X)
+#define _OCFxA(X)              OCF##X##A
+#define OCFxA(X)               _OCFxA(X)
 
 #define _TIMER_COMPA_VECTOR(X) TIMER##X##_COMPA_vect
 #define TIMER_COMPA_VECTOR(X)  _TIMER_COMPA_VECTOR(X)
 
+// Input Capture Unit, available only on 16-bit timers. CAPTURE_PIN is the Arduino pin connected to
+// the ICPx input of the selected timer, if it is exposed by the board.
+#if TIMER_ID == 1 && (defined(__AVR_ATmega328P__) || defined(__AVR_ATmega328PB__)                  \
+                      || defined(__AVR_ATmega168__))
+#define CAPTURE_PIN 8
+#elif TIMER_ID == 1 && defined(__AVR_ATmega32U4__)
+#define CAPTURE_PIN 4
+#elif TIMER_ID == 4 && defined(__AVR_ATmega2560__)
+#define CAPTURE_PIN 49
+#elif TIMER_ID == 5 && defined(__AVR_ATmega2560__)
+#define CAPTURE_PIN 48
+#endif
+
+#define _ICRx(X)               ICR##X
+#define ICRx(X)                _ICRx(X)
+#define _ICIEx(X)              ICIE##X
+#define ICIEx(X)               _ICIEx(X)
+#define _ICFx(X)               ICF##X
+#define ICFx(X)                _ICFx(X)
+#define _ICESx(X)              ICES##X
+#define ICESx(X)               _ICESx(X)
+#define _ICNCx(X)              ICNC##X
+#define ICNCx(X)               _ICNCx(X)
+#define _TIMER_CAPT_VECTOR(X)  TIMER##X##_CAPT_vect
+#define TIMER_CAPT_VECTOR(X)   _TIMER_CAPT_VECTOR(X)
+
+// Pins driven by the output compare channels B and C of the selected timer, if exposed by the
+// board.
+#if TIMER_ID == 1 && (defined(__AVR_ATmega328P__) || defined(__AVR_ATmega328PB__)                  \
+                      || defined(__AVR_ATmega168__))
+#define COMPARE_B_PIN 10
+#elif TIMER_ID == 1 && defined(__AVR_ATmega32U4__)
+#define COMPARE_B_PIN 10
+#define COMPARE_C_PIN 11
+#elif TIMER_ID == 1 && defined(__AVR_ATmega2560__)
+#define COMPARE_B_PIN 12
+#define COMPARE_C_PIN 13
+#endif
+
+#define _TCCRxC(X)             TCCR##X##C
+#define TCCRxC(X)              _TCCRxC(X)
+#define _OCRxBH(X)             OCR##X##BH
+#define OCRxBH(X)              _OCRxBH(X)
+#define _OCRxBL(X)             OCR##X##BL
+#define OCRxBL(X)              _OCRxBL(X)
+#define _COMxB0(X)             COM##X##B0
+#define COMxB0(X)              _COMxB0(X)
+#define _FOCxB(X)              FOC##X##B
+#define FOCxB(X)               _FOCxB(X)
+#define _OCRxCH(X)             OCR##X##CH
+#define OCRxCH(X)              _OCRxCH(X)
+#define _OCRxCL(X)             OCR##X##CL
+#define OCRxCL(X)              _OCRxCL(X)
+#define _COMxC0(X)             COM##X##C0
+#define COMxC0(X)              _COMxC0(X)
+#define _FOCxC(X)              FOC##X##C
+#define FOCxC(X)               _FOCxC(X)
+
 static void (*timer_callback)() = nullptr;
 
+#ifdef CAPTURE_PIN
+static void (*capture_callback)() = nullptr;
+
+ISR(TIMER_CAPT_VECTOR(TIMER_ID)) {
+  capture_callback();
+}
+#endif
+
 ISR(TIMER_COMPA_VECTOR(TIMER_ID)) {
   // Disable interrupt of Output Compare A
-  TIMSKx(TIMER_ID) &= 0b11111101;
+  TIMSKx(TIMER_ID) &= ~(1 << OCIExA(TIMER_ID));
 
   if (timer_callback != nullptr) { timer_callback(); }
 }
@@ -109,10 +179,10 @@ uint16_t microsecond2Tick(uint16_t micro) {
 }
 
 void timerBegin() {
-  // clean control registers TCCRxA and TCC2B registers
+  // clean control registers TCCRxA and TCC2B registers, i.e. set Normal mode: the counter
+  // is not cleared on compare match, so the alarms are absolute w.r.t. timerStart()
   TCCRxA(TIMER_ID) = 0;
-  // Set CTC mode
-  TCCRxB(TIMER_ID) = 0x08;
+  TCCRxB(TIMER_ID) = 0;
 
   // Reset the counter
   // From the AVR datasheet: "To do a 16-bit write, the high byte must be written
@@ -130,37 +200,27 @@ void timerSetCallback(void (*f)()) {
   timer_callback = f;
 }
 
-void timerStartAndTrigger(uint16_t tick) {
-  timerStop();
-
-#if N_BIT_TIMER == 8
-  TCNTx(TIMER_ID) = 0;
-#elif N_BIT_TIMER == 16
-  TCNTxH(TIMER_ID) = 0;
-  TCNTxL(TIMER_ID) = 0;
-#endif
+void timerStart(uint16_t tick) {
+  // disable interrupt of Output Compare A until the next alarm
+  TIMSKx(TIMER_ID) &= ~(1 << OCIExA(TIMER_ID));
 
-  tick--;
 #if N_BIT_TIMER == 8
-  OCRxA(TIMER_ID) = tick;
+  TCNTx(TIMER_ID) = tick;
 #elif N_BIT_TIMER == 16
-  OCRxAH(TIMER_ID) = tick >> 8;
-  OCRxAL(TIMER_ID) = tick;
+  TCNTxH(TIMER_ID) = tick >> 8;
+  TCNTxL(TIMER_ID) = tick;
 #endif
 
 #if N_BIT_TIMER == 8
   // 0x07: start counter with prescaler 1024
   TCCRxB(TIMER_ID) = 0x07;
 #elif N_BIT_TIMER == 16
-  // 0x02: start counter with prescaler 8
-  TCCRxB(TIMER_ID) |= 0x02;
+  // 0x02: start counter with prescaler 8 (the other bits hold the input capture settings)
+  TCCRxB(TIMER_ID) = (TCCRxB(TIMER_ID) & 0b11111000) | 0x02;
 #endif
-
-  // enable interrupt of Output Compare A
-  TIMSKx(TIMER_ID) = 1 << OCIExA(TIMER_ID);
 }
 
-void timerSetAlarm(uint16_t tick) {
+bool timerSetAlarm(uint16_t tick) {
 #if N_BIT_TIMER == 8
   OCRxA(TIMER_ID) = tick;
 #elif N_BIT_TIMER == 16
@@ -168,12 +228,131 @@ void timerSetAlarm(uint16_t tick) {
   OCRxAL(TIMER_ID) = tick;
 #endif
 
-  // enable interrupt of Output Compare A
-  TIMSKx(TIMER_ID) = 1 << OCIExA(TIMER_ID);
+  // Clear a stale compare match (the flag is set even if the interrupt is disabled),
+  // then enable interrupt of Output Compare A
+  TIFRx(TIMER_ID) = 1 << OCFxA(TIMER_ID);
+  TIMSKx(TIMER_ID) |= 1 << OCIExA(TIMER_ID);
+
+  // In Normal mode, the compare match doesn't happen if the counter is already beyond
+  // the tick. If the match has just happened, the interrupt is cancelled as well, so the
+  // caller is the only one in charge of the late alarm.
+  if (TCNTx(TIMER_ID) >= tick) {
+    TIMSKx(TIMER_ID) &= ~(1 << OCIExA(TIMER_ID));
+    TIFRx(TIMER_ID) = 1 << OCFxA(TIMER_ID);
+    return false;
+  }
+  return true;
+}
+
+uint16_t timerRead() {
+  return TCNTx(TIMER_ID);
 }
 
 void timerStop() {
+#ifdef CAPTURE_PIN
+  // The counter must keep running to timestamp the edges
+  if (TIMSKx(TIMER_ID) & (1 << ICIEx(TIMER_ID))) {
+    TIMSKx(TIMER_ID) &= ~(1 << OCIExA(TIMER_ID));
+    return;
+  }
+#endif
   TCCRxB(TIMER_ID) &= 0b11111000;
 }
 
+bool timerCaptureBegin(uint8_t pin, uint8_t mode, void (*callback)()) {
+#ifdef CAPTURE_PIN
+  // The edge select is fixed, both edges cannot be captured
+  if (pin != CAPTURE_PIN || (mode != RISING && mode != FALLING)) { return false; }
+
+  capture_callback = callback;
+
+  // Enable the noise canceler, it delays the capture by 4 clock cycles
+  TCCRxB(TIMER_ID) |= 1 << ICNCx(TIMER_ID);
+  if (mode == RISING) {
+    TCCRxB(TIMER_ID) |= 1 << ICESx(TIMER_ID);
+  } else {
+    TCCRxB(TIMER_ID) &= ~(1 << ICESx(TIMER_ID));
+  }
+
+  // Changing the edge may set the flag, so clear it before enabling the interrupt
+  TIFRx(TIMER_ID) = 1 << ICFx(TIMER_ID);
+  TIMSKx(TIMER_ID) |= 1 << ICIEx(TIMER_ID);
+
+  // The counter is free-running from now on
+  if ((TCCRxB(TIMER_ID) & 0b00000111) == 0) { TCCRxB(TIMER_ID) |= 0x02; }
+  return true;
+#else
+  (void)pin;
+  (void)mode;
+  (void)callback;
+  return false;
+#endif
+}
+
+void timerCaptureEnd() {
+#ifdef CAPTURE_PIN
+  TIMSKx(TIMER_ID) &= ~(1 << ICIEx(TIMER_ID));
+#endif
+}
+
+uint16_t timerCaptureRead() {
+#ifdef CAPTURE_PIN
+  return ICRx(TIMER_ID);
+#else
+  return 0;
+#endif
+}
+
+uint8_t timerComparePin(uint8_t pin) {
+#ifdef COMPARE_B_PIN
+  if (pin == COMPARE_B_PIN) { return TIMER_COMPARE_B; }
+#endif
+#ifdef COMPARE_C_PIN
+  if (pin == COMPARE_C_PIN) { return TIMER_COMPARE_C; }
+#endif
+  (void)pin;
+  return 0;
+}
+
+void timerCompareFire(uint8_t channel, uint16_t tick) {
+  // COMx1:0 = 0b11 sets the pin on compare match. If the counter is already beyond the tick, the
+  // match is forced: if it happened meanwhile, forcing it again doesn't change the pin.
+#ifdef COMPARE_B_PIN
+  if (channel == TIMER_COMPARE_B) {
+    OCRxBH(TIMER_ID) = tick >> 8;
+    OCRxBL(TIMER_ID) = tick;
+    TCCRxA(TIMER_ID) |= 0b11 << COMxB0(TIMER_ID);
+    if (TCNTx(TIMER_ID) >= tick) { TCCRxC(TIMER_ID) = 1 << FOCxB(TIMER_ID); }
+  }
+#endif
+#ifdef COMPARE_C_PIN
+  if (channel == TIMER_COMPARE_C) {
+    OCRxCH(TIMER_ID) = tick >> 8;
+    OCRxCL(TIMER_ID) = tick;
+    TCCRxA(TIMER_ID) |= 0b11 << COMxC0(TIMER_ID);
+    if (TCNTx(TIMER_ID) >= tick) { TCCRxC(TIMER_ID) = 1 << FOCxC(TIMER_ID); }
+  }
+#endif
+  (void)channel;
+  (void)tick;
+}
+
+void timerCompareClear(uint8_t channels) {
+  // COMx1:0 = 0b10 clears the pin on compare match, then the match is forced. The pin stays
+  // connected to the output compare unit, so it is low until the next timerCompareFire(..).
+#ifdef COMPARE_B_PIN
+  if (channels & TIMER_COMPARE_B) {
+    TCCRxA(TIMER_ID) = (TCCRxA(TIMER_ID) & ~(0b11 << COMxB0(TIMER_ID))) | 0b10 << COMxB0(TIMER_ID);
+    TCCRxC(TIMER_ID) = 1 << FOCxB(TIMER_ID);
+  }
+#endif
+#ifdef COMPARE_C_PIN
+  if (channels & TIMER_COMPARE_C) {
+    TCCRxA(TIMER_ID) = (TCCRxA(TIMER_ID) & ~(0b11 << COMxC0(TIMER_ID))) | 0b10 << COMxC0(TIMER_ID);
+    TCCRxC(TIMER_ID) = 1 << FOCxC(TIMER_ID);
+  }
+#endif
+  (void)channels;
+}
+
 #endif  // END AVR
@@ -46,19 +46,69 @@ void timerBegin();
 void timerSetCallback(void (*f)());
 
 /**
- * Let's start the timer: it triggers after x ticks,
- * then it stops.
- * tick length depends on MCU clock and prescaler, please use
- * microsecond2Tick(..) to feed timerStart(..).
- *
- * NOTE: 0 or 1 values are not accepted
+ * Set the counter to the given tick and start counting, without any alarm. The counter value 0
+ * is the origin of the alarms set by timerSetAlarm(..), so a tick greater than 0 places the
+ * origin in the past.
  */
-void timerStartAndTrigger(uint16_t tick);
+void timerStart(uint16_t tick = 0);
 
-void timerSetAlarm(uint16_t tick);
+/**
+ * Set the alarm to trigger when the counter reaches the given tick, i.e. the time is
+ * absolute w.r.t. the last timerStart(). Tick length depends on MCU clock and prescaler,
+ * please use microsecond2Tick(..) to feed it.
+ * Return false if the tick is already passed, in this case the alarm is not set.
+ */
+bool timerSetAlarm(uint16_t tick);
 
+/**
+ * Return the ticks elapsed from the last timerStart().
+ */
+uint16_t timerRead();
+
+/**
+ * Stop the counter and the alarm. If the input capture is enabled, only the alarm is stopped.
+ */
 void timerStop();
 
+/**
+ * Enable the input capture: the counter value is latched by the hardware on the edge of the
+ * given pin, then the callback is called. Mode is RISING or FALLING.
+ * Return false if the pin is not connected to the input capture unit of the timer, or the mode
+ * is not supported.
+ */
+bool timerCaptureBegin(uint8_t pin, uint8_t mode, void (*callback)());
+
+void timerCaptureEnd();
+
+/**
+ * Return the counter value latched on the last edge.
+ */
+uint16_t timerCaptureRead();
+
+/**
+ * Output compare channels of the timer that can drive a pin without the CPU, besides the channel A
+ * used by the alarm. They are used as bitmasks.
+ */
+#define TIMER_COMPARE_B        0x01
+#define TIMER_COMPARE_C        0x02
+#define TIMER_COMPARE_CHANNELS 2
+
+/**
+ * Return the output compare channel driving the given pin, 0 if none.
+ */
+uint8_t timerComparePin(uint8_t pin);
+
+/**
+ * Raise the pin of the channel when the counter reaches the given tick (absolute as the alarms), or
+ * immediately if the tick is already passed. The pin stays high until timerCompareClear(..).
+ */
+void timerCompareFire(uint8_t channel, uint16_t tick);
+
+/**
+ * Lower immediately the pins of the given channels (bitmask).
+ */
+void timerCompareClear(uint8_t channels);
+
 #endif  // HW_TIMER_ARDUINO_H
 
 #endif  // END AVR
@@ -36,19 +36,27 @@ void timerInit(void (*callback)()) {
   timerAttachInterrupt(timer, callback, false);
 }
 
-void ARDUINO_ISR_ATTR startTimerAndTrigger(uint32_t delay) {
-  timerWrite(timer, 0);
-  timerAlarmWrite(timer, delay, false);
-  timerAlarmEnable(timer);
+void ARDUINO_ISR_ATTR startTimer(uint32_t elapsed) {
+  timerAlarmDisable(timer);
+  timerWrite(timer, elapsed);
   timerStart(timer);
 }
 
-void ARDUINO_ISR_ATTR setAlarm(uint32_t delay) {
+bool ARDUINO_ISR_ATTR setAlarm(uint32_t delay) {
+  // The alarm triggers only when the counter reaches the value, hence a passed time would
+  // be lost. The margin covers the time to write the alarm.
+  if (timerRead(timer) + 2 >= delay) { return false; }
+
   timerAlarmWrite(timer, delay, false);
 
   // On core v2.0.0-2.0.1, the timer alarm is automatically disabled after triggering,
   // so re-enable the alarm
   timerAlarmEnable(timer);
+  return true;
+}
+
+uint32_t ARDUINO_ISR_ATTR readTimer() {
+  return timerRead(timer);
 }
 
 void ARDUINO_ISR_ATTR stopTimer() {
@@ -29,9 +29,24 @@
 
 void timerInit(void (*callback)());
 
-void startTimerAndTrigger(uint32_t delay);
+/**
+ * Set the counter to the given microseconds and start counting, without any alarm. The counter
+ * value 0 is the origin of the alarms set by setAlarm(..), so a value greater than 0 places the
+ * origin in the past.
+ */
+void startTimer(uint32_t elapsed = 0);
 
-void setAlarm(uint32_t delay);
+/**
+ * Set the alarm to trigger when the counter reaches the given microseconds, i.e. the time
+ * is absolute w.r.t. the last startTimer().
+ * Return false if the time is already passed, in this case the alarm is not set.
+ */
+bool setAlarm(uint32_t delay);
+
+/**
+ * Return the microseconds elapsed from the last startTimer().
+ */
+uint32_t readTimer();
 
 void stopTimer();
 
@@ -0,0 +1,53 @@
+/******************************************************************************
+ *  This file is part of Dimmable Light for Arduino, a library to control     *
+ *  dimmers.                                                                  *
+ *                                                                            *
+ *  Copyright (C) 2018-2023  Fabiano Riccardi                                 *
+ *                                                                            *
+ *  Dimmable Light for Arduino is free software; you can redistribute         *
+ *  it and/or modify it under the terms of the GNU Lesser General Public      *
+ *  License as published by the Free Software Foundation; either              *
+ *  version 2.1 of the License, or (at your option) any later version.        *
+ *                                                                            *
+ *  This library is distributed in the hope that it will be useful,           *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU          *
+ *  Lesser General Public License for more details.                           *
+ *                                                                            *
+ *  You should have received a copy of the GNU Lesser General Public License  *
+ *  along with this library; if not, see <http://www.gnu.org/licenses/>.      *
+ ******************************************************************************/
+#ifdef ARDUINO_ARCH_NATIVE
+
+#include "hw_timer_native.h"
+
+static void (*timer_callback)() = nullptr;
+static uint64_t origin = 0;
+
+void timerBegin() {}
+
+void timerSetCallback(void (*callback)()) {
+  timer_callback = callback;
+}
+
+void timerStart(uint32_t elapsed) {
+  origin = nativeClock() - elapsed;
+  nativeCancelAlarm();
+}
+
+bool timerSetAlarm(uint32_t t) {
+  if (origin + t <= nativeClock()) { return false; }
+  // The simulator calls the routine directly, so it can profile each of them
+  nativeScheduleAlarm(origin + t, timer_callback);
+  return true;
+}
+
+uint32_t timerRead() {
+  return nativeClock() - origin;
+}
+
+void timerStop() {
+  nativeCancelAlarm();
+}
+
+#endif  // END ARDUINO_ARCH_NATIVE
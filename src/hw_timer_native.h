@@ -0,0 +1,90 @@
+/******************************************************************************
+ *  This file is part of Dimmable Light for Arduino, a library to control     *
+ *  dimmers.                                                                  *
+ *                                                                            *
+ *  Copyright (C) 2018-2023  Fabiano Riccardi                                 *
+ *                                                                            *
+ *  Dimmable Light for Arduino is free software; you can redistribute         *
+ *  it and/or modify it under the terms of the GNU Lesser General Public      *
+ *  License as published by the Free Software Foundation; either              *
+ *  version 2.1 of the License, or (at your option) any later version.        *
+ *                                                                            *
+ *  This library is distributed in the hope that it will be useful,           *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU          *
+ *  Lesser General Public License for more details.                           *
+ *                                                                            *
+ *  You should have received a copy of the GNU Lesser General Public License  *
+ *  along with this library; if not, see <http://www.gnu.org/licenses/>.      *
+ ******************************************************************************/
+
+/***********************************************************************************
+ * Timer for the host-native build, used to run the library in a simulator (see
+ * extras/native). The simulator provides a virtual clock and a single alarm, this
+ * file provides the same timer API of RP2040 on top of them.
+ ***********************************************************************************/
+#ifdef ARDUINO_ARCH_NATIVE
+
+#ifndef HW_TIMER_NATIVE_H
+#define HW_TIMER_NATIVE_H
+
+#include <stdint.h>
+
+/**
+ * Return the time of the virtual clock, in microseconds. It is provided by the simulator.
+ */
+uint64_t nativeClock();
+
+/**
+ * Call the callback when the virtual clock reaches the given time, replacing the pending alarm (if
+ * any). It is provided by the simulator.
+ */
+void nativeScheduleAlarm(uint64_t time, void (*callback)());
+
+/**
+ * Cancel the pending alarm, if any. It is provided by the simulator.
+ */
+void nativeCancelAlarm();
+
+/**
+ * Return a free-running counter of the host clock, in nanoseconds, to profile the ISRs. It is
+ * provided by the simulator.
+ */
+uint32_t nativeCycleCount();
+
+/**
+ * Initialize the timer.
+ */
+void timerBegin();
+
+/**
+ * Set callback function on timer triggers. It must be set before arming the alarm.
+ */
+void timerSetCallback(void (*callback)());
+
+/**
+ * Latch the origin of the alarms set by timerSetAlarm(..), the given microseconds before now,
+ * and cancel the pending alarm.
+ */
+void timerStart(uint32_t elapsed = 0);
+
+/**
+ * Set the alarm to trigger after the given microseconds from the origin latched by
+ * timerStart().
+ * Return false if the time is already passed, in this case the alarm is not set.
+ */
+bool timerSetAlarm(uint32_t t);
+
+/**
+ * Return the microseconds elapsed from the origin latched by timerStart().
+ */
+uint32_t timerRead();
+
+/**
+ * Cancel the pending alarm.
+ */
+void timerStop();
+
+#endif  // HW_TIMER_NATIVE_H
+
+#endif  // ARDUINO_ARCH_NATIVE
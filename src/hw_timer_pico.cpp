@@ -26,29 +26,46 @@
 static void (*timer_callback)() = nullptr;
 static alarm_id_t alarm_id;
 static alarm_pool_t *alarm_pool;
+static absolute_time_t origin;
 
 void timerBegin() {
-  alarm_pool = alarm_pool_get_default();
+  // The alarms fire on the core that created the pool, the default one belongs to core 0
+  alarm_pool = get_core_num() == 0 ? alarm_pool_get_default()
+                                   : alarm_pool_create_with_unused_hardware_alarm(4);
 }
 
 void timerSetCallback(void (*callback)()) {
   timer_callback = callback;
 }
 
-void timerStart(uint64_t t) {
+void timerStart(uint32_t elapsed) {
+  origin = from_us_since_boot(time_us_64() - elapsed);
+
   if (alarm_id) {
-    cancel_alarm(alarm_id);
+    alarm_pool_cancel_alarm(alarm_pool, alarm_id);
     alarm_id = 0;
   }
+}
 
-  alarm_id = alarm_pool_add_alarm_in_us(
-    alarm_pool, t,
+bool timerSetAlarm(uint32_t t) {
+  alarm_id = alarm_pool_add_alarm_at(
+    alarm_pool, delayed_by_us(origin, t),
     [](alarm_id_t, void *) -> int64_t {
-      if (timer_callback != nullptr) { timer_callback(); }
+      // Reset before the callback, since it may set the next alarm
       alarm_id = 0;
+      if (timer_callback != nullptr) { timer_callback(); }
       return 0;  // Do not reschedule alarm
     },
-    NULL, true);
+    NULL, false);
+
+  // 0 means the time is already passed (negative values are not expected, the pool has
+  // always a free slot since there is at most one pending alarm)
+  if (alarm_id == 0) { return false; }
+  return true;
+}
+
+uint32_t timerRead() {
+  return absolute_time_diff_us(origin, get_absolute_time());
 }
 
 #endif  // END ARDUINO_ARCH_RP2040
@@ -26,7 +26,7 @@
 #include <stdint.h>
 
 /**
- * Initialize the timer.
+ * Initialize the timer, the alarms fire on the calling core.
  */
 void timerBegin();
 
@@ -36,9 +36,22 @@ void timerBegin();
 void timerSetCallback(void (*callback)());
 
 /**
- * Start the timer to trigger after the specified number of microseconds.
+ * Latch the origin of the alarms set by timerSetAlarm(..), the given microseconds before now,
+ * and cancel the pending alarm.
  */
-void timerStart(uint64_t t);
+void timerStart(uint32_t elapsed = 0);
+
+/**
+ * Set the alarm to trigger after the given microseconds from the origin latched by
+ * timerStart().
+ * Return false if the time is already passed, in this case the alarm is not set.
+ */
+bool timerSetAlarm(uint32_t t);
+
+/**
+ * Return the microseconds elapsed from the origin latched by timerStart().
+ */
+uint32_t timerRead();
 
 #endif  // HW_TIMER_PICO_H
 
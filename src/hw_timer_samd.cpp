@@ -46,6 +46,11 @@
 #define TCx_IRQn(X)     _TCx_IRQn(X)
 #define _TCx_(X)        TC##X##_
 #define TCx_(X)         _TCx_(X)
+#define _EVSYS_ID_USER_TCx_EVU(X) EVSYS_ID_USER_TC##X##_EVU
+#define EVSYS_ID_USER_TCx_EVU(X)  _EVSYS_ID_USER_TCx_EVU(X)
+
+// Event System channel routing the EIC event to the timer, used by the input capture
+#define EVSYS_CHANNEL 0
 
 #if TIMER_ID == 3
 #define GCLK_CLKCTRL_ID_x GCLK_CLKCTRL_ID_TCC2_TC3
@@ -56,16 +61,31 @@
 #endif
 
 static void (*timer_callback)() = nullptr;
+static void (*capture_callback)() = nullptr;
+
+// External interrupt line of the captured pin, if input capture is enabled
+static int captureExtInt = -1;
 
 void TCx_Handler(TIMER_ID)() {
-  TCx(TIMER_ID)->COUNT16.CTRLA.bit.ENABLE = 0;
-  // Wait until TC3 is enabled
-  while (TCx(TIMER_ID)->COUNT16.STATUS.bit.SYNCBUSY == 1)
-    ;
+  uint8_t flags = TCx(TIMER_ID)->COUNT16.INTFLAG.reg & TCx(TIMER_ID)->COUNT16.INTENSET.reg;
 
-  TCx(TIMER_ID)->COUNT16.INTFLAG.bit.MC0 = 1;
+  if (flags & TC_INTFLAG_MC1) {
+    TCx(TIMER_ID)->COUNT16.INTFLAG.reg = TC_INTFLAG_MC1;
 
-  timer_callback();
+    capture_callback();
+
+    // The capture callback restarts the schedule and may set a new alarm, clearing the flag of the
+    // previous one
+    flags = TCx(TIMER_ID)->COUNT16.INTFLAG.reg & TCx(TIMER_ID)->COUNT16.INTENSET.reg;
+  }
+
+  // The alarm may have been withdrawn by timerSetAlarm(..) while the interrupt was pending
+  if (flags & TC_INTFLAG_MC0) {
+    TCx(TIMER_ID)->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+    TCx(TIMER_ID)->COUNT16.INTENCLR.reg = TC_INTENCLR_MC0;
+
+    timer_callback();
+  }
 }
 
 uint16_t microsecond2Tick(uint16_t micro) {
@@ -73,7 +93,9 @@ uint16_t microsecond2Tick(uint16_t micro) {
   static const uint32_t OSC8M_FREQ = 8000000;
   static const uint32_t baseFreq = OSC8M_FREQ / 2;
   static const uint16_t baseFreqForMicro = baseFreq / 1000000;
-  if (micro > 10000) { return 0; }
+  // The counter holds up to 16383 us, i.e. the semi-period down to 30.5 Hz, longer times saturate
+  static const uint16_t maxMicro = UINT16_MAX / baseFreqForMicro;
+  if (micro > maxMicro) { return UINT16_MAX; }
   return baseFreqForMicro * micro;
 }
 
@@ -106,9 +128,8 @@ void timerBegin() {
   TCx(TIMER_ID)->COUNT16.CTRLBCLR.bit.DIR = 1;
 
   TCx(TIMER_ID)->COUNT16.CTRLC.bit.CPTEN0 = 0;
-  TCx(TIMER_ID)->COUNT16.INTENSET.bit.MC0 = 1;  // Enable TCx compare mode interrupt generation //
-                                                // Enable match interrupts on compare channel 0
-  TCx(TIMER_ID)->COUNT16.CC[0].reg = 0;         // Initialize the compare register
+  // Match interrupts on compare channel 0 are enabled by timerSetAlarm(..)
+  TCx(TIMER_ID)->COUNT16.CC[0].reg = 0;  // Initialize the compare register
 
   NVIC_EnableIRQ(TCx_IRQn(TIMER_ID));  // Enable TCx NVIC Interrupt Line
 }
@@ -117,21 +138,107 @@ void timerSetCallback(void (*callback)()) {
   timer_callback = callback;
 }
 
-void timerStart(uint16_t t) {
-  if (t <= 1) { return; }
+void timerStart(uint16_t tick) {
+  // Disable the alarm until the next timerSetAlarm(..)
+  TCx(TIMER_ID)->COUNT16.INTENCLR.reg = TC_INTENCLR_MC0;
+
+  TCx(TIMER_ID)->COUNT16.COUNT.reg = tick;
+  while (TCx(TIMER_ID)->COUNT16.STATUS.bit.SYNCBUSY == 1)
+    ;
+
+  if (TCx(TIMER_ID)->COUNT16.CTRLA.bit.ENABLE == 0) {
+    TCx(TIMER_ID)->COUNT16.CTRLA.bit.ENABLE = 1;
+    // Wait until Timer is enabled
+    while (TCx(TIMER_ID)->COUNT16.STATUS.bit.SYNCBUSY == 1)
+      ;
+  }
+}
+
+bool timerSetAlarm(uint16_t tick) {
+  TCx(TIMER_ID)->COUNT16.CC[0].reg = tick;
+  while (TCx(TIMER_ID)->COUNT16.STATUS.bit.SYNCBUSY == 1)
+    ;
+  TCx(TIMER_ID)->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+  TCx(TIMER_ID)->COUNT16.INTENSET.reg = TC_INTENSET_MC0;
+
+  // The counter is free-running, so a tick already passed would match only after the
+  // overflow: in that case withdraw the alarm and let the caller serve it
+  if (timerRead() >= tick) {
+    TCx(TIMER_ID)->COUNT16.INTENCLR.reg = TC_INTENCLR_MC0;
+    TCx(TIMER_ID)->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+    return false;
+  }
+  return true;
+}
+
+uint16_t timerRead() {
+  TCx(TIMER_ID)->COUNT16.READREQ.reg = TC_READREQ_RREQ | TC_READREQ_ADDR(0x10);
+  while (TCx(TIMER_ID)->COUNT16.STATUS.bit.SYNCBUSY == 1)
+    ;
+  return TCx(TIMER_ID)->COUNT16.COUNT.reg;
+}
+
+void timerStop() {
+  TCx(TIMER_ID)->COUNT16.INTENCLR.reg = TC_INTENCLR_MC0;
 
-  TCx(TIMER_ID)->COUNT16.COUNT.reg = 0;
+  // The counter must keep running to timestamp the edges
+  if (captureExtInt >= 0) { return; }
+
+  TCx(TIMER_ID)->COUNT16.CTRLA.bit.ENABLE = 0;
+  // Wait until Timer is disabled
   while (TCx(TIMER_ID)->COUNT16.STATUS.bit.SYNCBUSY == 1)
     ;
+}
+
+static void dummyIsr() {}
+
+bool timerCaptureBegin(uint8_t pin, uint32_t mode, void (*callback)()) {
+  int extInt = g_APinDescription[pin].ulExtInt;
+  if (extInt == NOT_AN_INTERRUPT || extInt == EXTERNAL_INT_NMI) { return false; }
+
+  capture_callback = callback;
+
+  // Let the core configure pin multiplexing and edge detection of the EIC, then route the edge to
+  // the Event System instead of the EIC interrupt
+  attachInterrupt(pin, dummyIsr, mode);
+  EIC->INTENCLR.reg = 1 << extInt;
+  EIC->EVCTRL.reg |= 1 << extInt;
 
-  TCx(TIMER_ID)->COUNT16.CC[0].reg = t;
+  // EIC event -> TC event input, asynchronous path (no clock needed)
+  PM->APBCMASK.reg |= PM_APBCMASK_EVSYS;
+  EVSYS->USER.reg = EVSYS_USER_CHANNEL(EVSYS_CHANNEL + 1) | EVSYS_USER_USER(EVSYS_ID_USER_TCx_EVU(TIMER_ID));
+  EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(EVSYS_CHANNEL) | EVSYS_CHANNEL_PATH_ASYNCHRONOUS
+                       | EVSYS_CHANNEL_EVGEN(EVSYS_ID_GEN_EIC_EXTINT_0 + extInt);
+
+  // The capture configuration is enable-protected
+  TCx(TIMER_ID)->COUNT16.CTRLA.bit.ENABLE = 0;
   while (TCx(TIMER_ID)->COUNT16.STATUS.bit.SYNCBUSY == 1)
     ;
+  TCx(TIMER_ID)->COUNT16.CTRLC.reg |= TC_CTRLC_CPTEN1;
+  while (TCx(TIMER_ID)->COUNT16.STATUS.bit.SYNCBUSY == 1)
+    ;
+  TCx(TIMER_ID)->COUNT16.EVCTRL.reg = TC_EVCTRL_TCEI | TC_EVCTRL_EVACT_OFF;
+  TCx(TIMER_ID)->COUNT16.INTFLAG.reg = TC_INTFLAG_MC1;
+  TCx(TIMER_ID)->COUNT16.INTENSET.reg = TC_INTENSET_MC1;
 
+  // The counter is free-running from now on
+  captureExtInt = extInt;
   TCx(TIMER_ID)->COUNT16.CTRLA.bit.ENABLE = 1;
-  // Wait until Timer is enabled
   while (TCx(TIMER_ID)->COUNT16.STATUS.bit.SYNCBUSY == 1)
     ;
+  return true;
+}
+
+void timerCaptureEnd() {
+  if (captureExtInt < 0) { return; }
+
+  TCx(TIMER_ID)->COUNT16.INTENCLR.reg = TC_INTENCLR_MC1;
+  EIC->EVCTRL.reg &= ~(1 << captureExtInt);
+  captureExtInt = -1;
+}
+
+uint16_t timerCaptureRead() {
+  return TCx(TIMER_ID)->COUNT16.CC[1].reg;
 }
 
 #endif  // END ARDUINO_ARCH_SAMD
\ No newline at end of file
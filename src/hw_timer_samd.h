@@ -31,7 +31,7 @@
 
 /**
  * Convert from microsecond to tick.
- * Max microseconds value is 10000, for higher values it returns 0.
+ * Max microseconds value is 16383, for higher values it returns the max tick (65535).
  */
 uint16_t microsecond2Tick(uint16_t micro);
 
@@ -46,11 +46,43 @@ void timerBegin();
 void timerSetCallback(void (*callback)());
 
 /**
- * Start the timer to trigger after the specified number of ticks.
- *
- * NOTE: 0 or 1 values are not accepted
+ * Set the counter to the given tick and start counting, without any alarm. The counter value 0
+ * is the origin of the alarms set by timerSetAlarm(..), so a tick greater than 0 places the
+ * origin in the past.
  */
-void timerStart(uint16_t tick);
+void timerStart(uint16_t tick = 0);
+
+/**
+ * Set the alarm to trigger when the counter reaches the given tick, i.e. the time is
+ * absolute w.r.t. the last timerStart().
+ * Return false if the tick is already passed, in this case the alarm is not set.
+ */
+bool timerSetAlarm(uint16_t tick);
+
+/**
+ * Return the ticks elapsed from the last timerStart().
+ */
+uint16_t timerRead();
+
+/**
+ * Stop the counter and the alarm. If the input capture is enabled, only the alarm is stopped.
+ */
+void timerStop();
+
+/**
+ * Enable the input capture: the counter value is latched by the hardware on the edge of the
+ * given pin (routed through EIC and Event System), then the callback is called. Mode is RISING,
+ * FALLING or CHANGE.
+ * Return false if the pin has no external interrupt line.
+ */
+bool timerCaptureBegin(uint8_t pin, uint32_t mode, void (*callback)());
+
+void timerCaptureEnd();
+
+/**
+ * Return the counter value latched on the last edge.
+ */
+uint16_t timerCaptureRead();
 
 #endif  // HW_TIMER_SAMD_H
 
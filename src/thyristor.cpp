@@ -21,6 +21,10 @@
 #include "circular_queue.h"
 #include <Arduino.h>
 
+#if defined(ISR_STATS) && defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)
+#include <hardware/structs/systick.h>
+#endif
+
 #if defined(ARDUINO_ARCH_ESP8266)
 #include "hw_timer_esp8266.h"
 #elif defined(ARDUINO_ARCH_ESP32)
@@ -31,6 +35,8 @@
 #include "hw_timer_samd.h"
 #elif defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)
 #include "hw_timer_pico.h"
+#elif defined(ARDUINO_ARCH_NATIVE)
+#include "hw_timer_native.h"
 #else
 #error "only ESP8266, ESP32, AVR, SAMD & RP2040 (non-mbed) architectures are supported"
 #endif
@@ -40,19 +46,148 @@
 // This filter affects the MONITOR_FREQUENCY measurement.
 //#define FILTER_INT_PERIOD
 
+// Phase-locked timebase, it supersedes FILTER_INT_PERIOD. The semi-periods are started by the timer
+// at the predicted zero crossings, while the zero-cross interrupts only correct phase and frequency
+// of the prediction. The edges outside a window around the predicted zero crossing are ignored as
+// noise (see *pllWindow*), and the missing edges are synthesized (see *pllMaxMissed*).
+//#define ZC_PLL
+
+// Enable it if the zero-cross detector emits one edge per period instead of one per semi-period
+// (e.g. some half-wave optocoupler circuits). This option requires ZC_PLL enabled, which
+// synthesizes the other semi-period.
+//#define ZC_SINGLE_EDGE
+
+// Once the timebase is locked and settled, track only one zero crossing every ZC_DECIMATION
+// semi-periods (at most 8): the timer runs the others on its own and the zero-cross ISR returns
+// immediately. It lowers the interrupt load (e.g. for the Wi-Fi of ESP8266), but the frequency
+// changes and the loss of the signal are detected later. This option requires ZC_PLL enabled and excludes
+// MONITOR_FREQUENCY. With ZC_SINGLE_EDGE, it must be even.
+//#define ZC_DECIMATION 8
+
+// Timestamp the zero-cross edges through the input capture of the timer, so the origin of the
+// schedule (and the MONITOR_FREQUENCY samples) don't suffer the latency of the interrupt. It is
+// available on AVR (the sync pin must be the ICP pin of the timer, e.g. pin 8 on Arduino Uno) and
+// SAMD (any pin with an external interrupt). Otherwise, the edges are timestamped at the ISR
+// entry.
+//#define ZC_HW_CAPTURE
+
+#if defined(ZC_HW_CAPTURE) && (defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_SAMD))
+#define ZC_CAPTURE_AVAILABLE
+#endif
+
+// Fire the gates on the pins of the timer's output compare channels (pin 10 on Arduino Uno, 10 and
+// 11 on Leonardo, 12 and 13 on Mega) by hardware: the edge is exact to the timer tick, without the
+// latency and the jitter of the ISRs, and it doesn't need an interrupt. The gates on the other pins
+// are driven by the ISRs as usual. It is available on AVR and it excludes PREDEFINED_PULSE_LENGTH.
+//#define HW_COMPARE_GATES
+
+#if defined(HW_COMPARE_GATES) && defined(ARDUINO_ARCH_AVR)
+#define COMPARE_GATES_AVAILABLE
+#endif
+
+// Fire the gates through the MCPWM generators of ESP32 and ESP32-S3 (up to 12 gates, the others
+// are driven by the ISRs as usual). The MCPWM timers are reset by the zero-cross edges through the
+// sync input, so the firings are timed by hardware, without latency and jitter of the ISRs (e.g.
+// due to Wi-Fi). The edges are not filtered, so a noisy sync signal may shift the firings. It
+// requires ESP32 Arduino core 2.0.x and it excludes PREDEFINED_PULSE_LENGTH.
+//#define MCPWM_GATES
+
+#if defined(MCPWM_GATES) && defined(ARDUINO_ARCH_ESP32)
+#define MCPWM_GATES_AVAILABLE
+#include "hw_mcpwm_esp32.h"
+#endif
+
+// Run the phase control on a PIO state machine of RP2040: it waits for the zero-cross edge and
+// fires the gates with the accuracy of the CPU clock, walking through a table fed by DMA. The CPU
+// only writes a new table when the delays change, without interrupts. If no state machine or DMA
+// channel is free, the ISRs are used as usual. This option excludes ZC_PLL, MONITOR_FREQUENCY and
+// PREDEFINED_PULSE_LENGTH.
+//#define PIO_ENGINE
+
+#if defined(PIO_ENGINE) && defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)
+#define PIO_ENGINE_AVAILABLE
+#include "hw_pio_pico.h"
+#endif
+
+// Serve the zero-cross and timer interrupts of RP2040 on core 1, so the gates are fired regardless
+// of what the sketch, USB and serial do on core 0. Thyristor::begin() launches core 1, hence the
+// sketch must not define setup1() and loop1(), nor write the flash (e.g. EEPROM, LittleFS) while
+// dimming. The snapshots are exchanged between the cores under a hardware spinlock. This option
+// excludes PIO_ENGINE.
+//#define CORE1_ENGINE
+
+#if defined(CORE1_ENGINE) && defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)
+#define CORE1_ENGINE_AVAILABLE
+#include <hardware/sync.h>
+#include <pico/multicore.h>
+#endif
+
+#if defined(CORE1_ENGINE_AVAILABLE) && defined(PIO_ENGINE_AVAILABLE)
+#error "CORE1_ENGINE and PIO_ENGINE are mutually exclusive"
+#endif
+
+#if defined(ZC_PLL) && defined(FILTER_INT_PERIOD)
+#error "ZC_PLL and FILTER_INT_PERIOD are mutually exclusive"
+#endif
+
+#if defined(ZC_SINGLE_EDGE) && !defined(ZC_PLL)
+#error "ZC_SINGLE_EDGE requires ZC_PLL"
+#endif
+
+#ifdef ZC_DECIMATION
+#ifndef ZC_PLL
+#error "ZC_DECIMATION requires ZC_PLL"
+#endif
+#ifdef MONITOR_FREQUENCY
+#error "ZC_DECIMATION and MONITOR_FREQUENCY are mutually exclusive"
+#endif
+// Beyond 8, the noise of the estimated period, multiplied by ZC_DECIMATION, makes the phase drift
+// by several microseconds between the tracked edges
+#if ZC_DECIMATION < 2 || ZC_DECIMATION > 8
+#error "ZC_DECIMATION must be in [2; 8]"
+#endif
+#ifdef ZC_SINGLE_EDGE
+static_assert(ZC_DECIMATION % 2 == 0, "ZC_DECIMATION must be even with ZC_SINGLE_EDGE");
+#endif
+#endif
+
 // FOR DEBUG PURPOSE ONLY. This option requires FILTER_INT_PERIOD enabled.
 // Print on serial port the time passed from the previous zero cross interrupt when the semi-period
 // length is exceed the interval defined by *semiPeriodShrinkMargin* and *semiPeriodExpandMargin*.
 //#define PRINT_INT_PERIOD
 
 // FOR DEBUG PURPOSE ONLY.
-// Prints a char on the serial port if not all thyristors are managed in a semi-period.
+// Prints a char on the serial port if not all thyristors are managed in a semi-period. To count
+// them without printing from the ISR, see ISR_STATS in thyristor.h.
 //#define CHECK_MANAGED_THYR
 
-// Force the signal length of thyristor's gate. If not enabled, the signal to gate
-// is turned off through an interrupt just before the end of the period.
-// Look at gateTurnOffTime constant for more info.
-//#define PREDEFINED_PULSE_LENGTH
+// The signal length of thyristor's gate can be forced by PREDEFINED_PULSE_LENGTH, see
+// thyristor.h.
+
+#if defined(COMPARE_GATES_AVAILABLE) && defined(PREDEFINED_PULSE_LENGTH)
+#error "HW_COMPARE_GATES and PREDEFINED_PULSE_LENGTH are mutually exclusive"
+#endif
+
+#if defined(MCPWM_GATES_AVAILABLE) && defined(PREDEFINED_PULSE_LENGTH)
+#error "MCPWM_GATES and PREDEFINED_PULSE_LENGTH are mutually exclusive"
+#endif
+
+#if defined(PIO_ENGINE_AVAILABLE)                                                                  \
+  && (defined(ZC_PLL) || defined(MONITOR_FREQUENCY) || defined(PREDEFINED_PULSE_LENGTH))
+#error "PIO_ENGINE excludes ZC_PLL, MONITOR_FREQUENCY and PREDEFINED_PULSE_LENGTH"
+#endif
+
+#if defined(BURST_FIRE)                                                                            \
+  && (defined(COMPARE_GATES_AVAILABLE) || defined(MCPWM_GATES_AVAILABLE)                           \
+      || defined(PIO_ENGINE_AVAILABLE))
+#error "BURST_FIRE excludes HW_COMPARE_GATES, MCPWM_GATES and PIO_ENGINE"
+#endif
+
+#ifdef BURST_FIRE
+// The pattern has at least a semi-period, with a mask per port
+static_assert(BURST_PATTERN_SIZE >= MAX_THYRISTORS,
+              "BURST_PATTERN_SIZE must be at least MAX_THYRISTORS");
+#endif
 
 // In microseconds
 #ifdef NETWORK_FREQ_FIXED_50HZ
@@ -69,7 +204,8 @@ static uint16_t semiPeriodLength = 0;
 // Activation delays lower than *startMargin* turn the thyristor fully ON.
 // Activation delays higher than *endMargin* turn the thyristor fully OFF.
 // Tune this parameters accordingly to your setup (electrical network, MCU, and ZC circuitry).
-// Values are expressed in microseconds.
+// The constant offset of the ZC circuitry is compensated separately, see
+// Thyristor::setZeroCrossOffset(). Values are expressed in microseconds.
 static const uint16_t startMargin = 200;
 static const uint16_t endMargin = 500;
 
@@ -85,13 +221,20 @@ static const uint16_t endMargin = 500;
 // on AVR, you should set a bigger Merge Period (e.g. 100us). Moreover, you should also consider the
 // number of instantiated dimmers: ISRs will take more time as the dimmer count increases, so you
 // may need to increase Merge Period. The default value is intended to handle up to 8 dimmers.
-#if defined(ARDUINO_ARCH_AVR)
-//  This longer Merge Period is due to the implementation of digitalWrite(..) on AVR core, which is
-//  slower than others. In particular, on Arduino Uno R3 and Arduino Mega it takes,
-//  respectively, about 5us and 6us to execute.
-static const uint16_t mergePeriod = 20 + Thyristor::N * 6;
+// You can override it by defining MERGE_PERIOD (e.g. -DMERGE_PERIOD=50 in your build flags), or
+// let the library size it on the measured cost of the ISRs with ADAPTIVE_MERGE_PERIOD.
+#if defined(MERGE_PERIOD)
+static const uint16_t defaultMergePeriod = MERGE_PERIOD;
+#elif defined(ARDUINO_ARCH_AVR)
+//  This longer Merge Period is due to the slower AVR core. The gates are driven by writing
+//  directly the PORTx registers, each write takes less than 1us. Since the pins on the same port
+//  are merged, an ISR performs at most one write per port, i.e. the minimum between the number of
+//  thyristors and the number of ports (each port has 8 pins).
+static const uint16_t maxGateWrites =
+  Thyristor::N < (NUM_DIGITAL_PINS + 7) / 8 ? Thyristor::N : (NUM_DIGITAL_PINS + 7) / 8;
+static const uint16_t defaultMergePeriod = 20 + maxGateWrites;
 #else
-static const uint16_t mergePeriod = 20;
+static const uint16_t defaultMergePeriod = 20;
 #endif
 
 // Period in microseconds before the end of the semiperiod when an interrupt is triggered to
@@ -99,395 +242,1531 @@ static const uint16_t mergePeriod = 20;
 // PREDEFINED_PULSE_LENGTH.
 static const uint16_t gateTurnOffTime = 300;
 
-static_assert(endMargin - gateTurnOffTime > mergePeriod, "endMargin must be greater than "
-                                                         "(gateTurnOffTime + mergePeriod)");
+static_assert(endMargin - gateTurnOffTime > defaultMergePeriod, "endMargin must be greater than "
+                                                                "(gateTurnOffTime + mergePeriod)");
 
-#ifdef PREDEFINED_PULSE_LENGTH
-// Length of pulse on thyristor's gate pin. This parameter is not applied if thyristor is fully on
-// or off. This option is suitable only for very short pulses, since it blocks the ISR for the
-// specified amount of time.
-static uint8_t pulseWidth = 15;
+// In the worst case, each thyristor is activated by its own interrupt, and all of them must fit in
+// the semi-period (the 60Hz one, the shorter).
+static_assert((uint32_t)Thyristor::N * defaultMergePeriod < 8333 - startMargin - endMargin,
+              "MAX_THYRISTORS is too high for the current mergePeriod");
+
+#ifdef ADAPTIVE_MERGE_PERIOD
+// Bounds of the Merge Period sized at runtime, in microseconds. The upper one is the largest value
+// satisfying the constraints above.
+#if defined(ARDUINO_ARCH_ESP8266)
+static const uint16_t minMergePeriod = 10;
+#else
+static const uint16_t minMergePeriod = 4;
 #endif
+static const uint16_t maxMergePeriod =
+  endMargin - gateTurnOffTime - 1 < (8333 - startMargin - endMargin - 1) / Thyristor::N
+    ? endMargin - gateTurnOffTime - 1
+    : (8333 - startMargin - endMargin - 1) / Thyristor::N;
 
-struct PinDelay {
-  uint8_t pin;
-  uint16_t delay;
-};
+// The Merge Period is the measured cost of an event plus 1/4 of it plus this guard, in
+// microseconds.
+static const uint16_t mergePeriodGuard = 2;
+
+static uint16_t mergePeriod = defaultMergePeriod;
+
+// Number of events timed by the probe in begin(), and their interval in microseconds.
+static const uint8_t mergeProbes = 8;
+static const uint16_t mergeProbeInterval = 200;
+#else
+static const uint16_t mergePeriod = defaultMergePeriod;
+#endif
 
-enum class INT_TYPE { ACTIVATE_THYRISTORS, TURN_OFF_GATES };
+// Bound of the zero-cross detector offset, in microseconds.
+static const int16_t maxZeroCrossOffset = 1000;
 
-static INT_TYPE nextISR = INT_TYPE::ACTIVATE_THYRISTORS;
+// Offset of the zero-cross interrupt w.r.t. the actual zero crossing of the voltage, in
+// microseconds. See Thyristor::setZeroCrossOffset().
+static int16_t zeroCrossOffset = 0;
 
-/**
- * Temporary struct manipulated by the ISR storing the timing information about each dimmer.
- */
-static struct PinDelay pinDelay[Thyristor::N];
+// The ISR latency (in timer ticks) is estimated by an exponential moving average, whose weight is
+// 1 / 2^latencyFilterShift. The value is stored multiplied by 2^latencyFilterShift.
+static const uint8_t latencyFilterShift = 4;
+static volatile uint16_t filteredLatency = 0;
+
+// Latency samples higher than this value (in microseconds) are discarded, since they are due to
+// other interrupts or to ISRs of previous events taking too long, not to the ISR entry.
+static const uint16_t maxLatencySample = 100;
+
+#ifdef ADAPTIVE_MERGE_PERIOD
+// The cost of an event (in timer ticks), from its due time to the timer armed for the next one, is
+// filtered as the latency.
+static volatile uint16_t filteredEventCost = 0;
+#endif
+
+#ifdef PREDEFINED_PULSE_LENGTH
+// Default length of pulse on thyristor's gate pin, in microseconds. See Thyristor::setPulseWidth().
+static const uint16_t defaultPulseWidth = 15;
+#endif
 
 /**
- * Summary of thyristors' state used by ISR (concurrent-safe).
+ * Timer ticks, their length depends on the platform. The schedule is expressed in ticks, so the
+ * conversion from microseconds is not performed by the ISRs.
  */
-static bool _allThyristorsOnOff = true;
+typedef uint16_t timer_ticks_t;
 
 /**
- * Tell if zero-cross interrupt is enabled.
+ * Write to a GPIO port, it drives the gates of the thyristors on that port.
  */
-static bool interruptEnabled = false;
+struct GpioWrite {
+  gpio_port_t port;
+  gpio_mask_t mask;
+};
 
 /**
- * Number of thyristors already managed in the current semi-period.
+ * Range [first; last) into the array of GPIO writes.
  */
-static uint8_t thyristorManaged = 0;
+struct GpioRange {
+  thyristor_count_t first;
+  thyristor_count_t last;
+};
 
 /**
- * Number of thyristors FULLY on. The remaining ones must be turned
- * off by turn_off_gates_int at the end of the semi-period.
+ * A group of thyristors activated by the same timer interrupt.
  */
-static uint8_t alwaysOnCounter = 0;
-static uint8_t alwaysOffCounter = 0;
+struct FiringEvent {
+  /**
+   * Time of this event, in ticks from the zero cross. The schedule is absolute, so the latency of
+   * an ISR doesn't delay the following events.
+   */
+  timer_ticks_t ticks;
 
-#if defined(ARDUINO_ARCH_ESP8266)
-void HW_TIMER_IRAM_ATTR turn_off_gates_int() {
-#elif defined(ARDUINO_ARCH_ESP32)
-void ARDUINO_ISR_ATTR turn_off_gates_int() {
-#else
-void turn_off_gates_int() {
+  struct GpioRange gates;
+
+#ifdef PREDEFINED_PULSE_LENGTH
+  /**
+   * Tell if the gates are lowered at the end of their pulse, instead of raised.
+   */
+  bool off;
 #endif
-  for (int i = alwaysOnCounter; i < Thyristor::nThyristors; i++) {
-    digitalWrite(pinDelay[i].pin, LOW);
-  }
 
-#if defined(ARDUINO_ARCH_AVR)
-  timerStop();
+#ifdef GATE_TRACE
+  /**
+   * Pins of the gates, see Thyristor::TraceRecord.
+   */
+  uint64_t pins;
 #endif
-}
+};
 
+#ifdef COMPARE_GATES_AVAILABLE
 /**
- * Timer routine to turn on one or more thyristors. This function may be be called multiple times
- * per semi-period depending on the current thyristors configuration.
+ * A gate fired by an output compare channel of the timer, see HW_COMPARE_GATES.
  */
-#if defined(ARDUINO_ARCH_ESP8266)
-void HW_TIMER_IRAM_ATTR activate_thyristors() {
-#elif defined(ARDUINO_ARCH_ESP32)
-void ARDUINO_ISR_ATTR activate_thyristors() {
-#else
-void activate_thyristors() {
+struct CompareFiring {
+  uint8_t channel;
+  timer_ticks_t ticks;
+};
 #endif
 
-  const uint8_t firstToBeUpdated = thyristorManaged;
-
-  for (;
-       // The last thyristor is managed outside the loop
-       thyristorManaged < Thyristor::nThyristors - 1 &&
-       // Consider the "near" thyristors
-       pinDelay[thyristorManaged + 1].delay - pinDelay[firstToBeUpdated].delay < mergePeriod &&
-       // Exclude the one who must remain totally off
-       pinDelay[thyristorManaged].delay <= semiPeriodLength - endMargin;
-       thyristorManaged++) {
-    digitalWrite(pinDelay[thyristorManaged].pin, HIGH);
-  }
-  digitalWrite(pinDelay[thyristorManaged].pin, HIGH);
-  thyristorManaged++;
+#if defined(BURST_FIRE) && defined(GATE_TRACE)
+/**
+ * The gate of a thyristor in burst-fire mode, to trace the pins raised by the pattern.
+ */
+struct BurstGate {
+  uint8_t port;
+  gpio_mask_t mask;
+  uint64_t pins;
+};
+#endif
 
-  // This while is dedicated to all those thyristors with delay == semiPeriodLength-margin; those
-  // are the ones who shouldn't turn on, hence they can be skipped
-  while (thyristorManaged < Thyristor::nThyristors && pinDelay[thyristorManaged].delay == semiPeriodLength) {
-    thyristorManaged++;
-  }
+/**
+ * Snapshot of the thyristors' configuration, it is prepared in thread context and then consumed by
+ * the ISRs. It contains the firing schedule of a semi-period, already merged and converted to
+ * timer ticks, so the ISRs only have to walk through the events.
+ */
+struct Snapshot {
+  /**
+   * Summary of thyristors' state, see Thyristor::allThyristorsOnOff.
+   */
+  bool allThyristorsOnOff;
+
+  /**
+   * Number of events. If PREDEFINED_PULSE_LENGTH is enabled, the activation events are interleaved
+   * with the ones ending the pulses. Otherwise, they are followed by the event turning off the gates
+   * of the thyristors not always on.
+   */
+  thyristor_count_t nEvents;
 
 #ifdef PREDEFINED_PULSE_LENGTH
-  delayMicroseconds(pulseWidth);
+  struct FiringEvent events[2 * Thyristor::N];
+#else
+  struct FiringEvent events[Thyristor::N + 1];
+#endif
 
-  for (int i = firstToBeUpdated; i < thyristorManaged; i++) { digitalWrite(pinDelay[i].pin, LOW); }
+  /**
+   * Gates of all the thyristors and of the ones FULLY on.
+   */
+  struct GpioRange allGates;
+  struct GpioRange alwaysOnGates;
+
+  /**
+   * Each pin appears at most once among all the gates, always on and events' ranges (the gate-off
+   * event excludes the always on ones), hence 3 writes per thyristor are enough.
+   */
+  struct GpioWrite writes[3 * Thyristor::N];
+
+#ifdef GATE_TRACE
+  uint64_t allPins;
+  uint64_t alwaysOnPins;
 #endif
 
-  if (thyristorManaged < Thyristor::nThyristors) {
-    int delayAbsolute = pinDelay[thyristorManaged].delay;
+#ifdef COMPARE_GATES_AVAILABLE
+  /**
+   * Output compare channels of all the thyristors, and of the ones lowered by the gate-off event
+   * (i.e. fired after the zero cross). Their gates are not part of the writes.
+   */
+  uint8_t compareChannels;
+  uint8_t compareOffChannels;
 
-#if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_SAMD) || (defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED))
-    int delayRelative = delayAbsolute - pinDelay[firstToBeUpdated].delay;
+  uint8_t nCompareFirings;
+  struct CompareFiring compareFirings[TIMER_COMPARE_CHANNELS];
 #endif
 
-#if defined(ARDUINO_ARCH_ESP8266)
-    timer1_write(US_TO_RTC_TIMER_TICKS(delayRelative));
-#elif defined(ARDUINO_ARCH_ESP32)
-    setAlarm(delayAbsolute);
-#elif defined(ARDUINO_ARCH_AVR)
-    timerSetAlarm(microsecond2Tick(delayRelative));
-#elif defined(ARDUINO_ARCH_SAMD)
-  timerStart(microsecond2Tick(delayRelative));
-#elif defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)
-  timerStart(delayRelative);
-#else
-  #error "Not implemented"
+#ifdef BURST_FIRE
+  /**
+   * Pattern of the thyristors in burst-fire mode, whose gates are not part of the events. It
+   * repeats every burstLength semi-periods, 0 if none: each one has a mask per port, raised at the
+   * zero cross.
+   */
+  uint16_t burstLength;
+  thyristor_count_t nBurstPorts;
+  gpio_port_t burstPorts[Thyristor::N];
+  gpio_mask_t burstMasks[BURST_PATTERN_SIZE];
+
+#ifdef GATE_TRACE
+  thyristor_count_t nBurstGates;
+  struct BurstGate burstGates[Thyristor::N];
 #endif
-  } else {
+#endif
+};
 
-#ifdef PREDEFINED_PULSE_LENGTH
-    // If there are not more thyristor to serve, I can stop timer. Energy saving?
-#if defined(ARDUINO_ARCH_ESP8266)
-    // Given the Arduino HAL and esp8266 technical reference manual,
-    // when timer triggers, the counter stops because it has reach zero
-    // and no-autorealod was set (this timer can only down-count).
-#elif defined(ARDUINO_ARCH_ESP32)
-    stopTimer();
-#elif defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_SAMD)
-    // Given actual HAL, AVR and SAMD counter automatically stops on interrupt
-#elif defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)
-    // Timer callback is not rescheduled
+/**
+ * Routine served by the next timer interrupt, see isr_selector() (ESP32 only).
+ */
+static void (*nextISR)() = nullptr;
+
+/**
+ * Triple buffer of snapshots. At any time, a snapshot is owned by the ISRs, one is owned by the
+ * thread context (i.e. it is being prepared), and the last one is the latest published. The
+ * ownership is exchanged by swapping the indexes, so the ISR never copies the snapshot and never
+ * skips an update.
+ */
+static struct Snapshot snapshots[3] = { { true, 0, {}, { 0, 0 }, { 0, 0 }, {},
+#ifdef GATE_TRACE
+                                          0, 0,
 #endif
-#else
-    // If there are not more thyristors to serve, set timer to turn off gates' signal
-    uint16_t delayAbsolute = semiPeriodLength - gateTurnOffTime;
+#ifdef COMPARE_GATES_AVAILABLE
+                                          0, 0, 0, {},
+#endif
+#ifdef BURST_FIRE
+                                          0, 0, {}, {},
+#ifdef GATE_TRACE
+                                          0, {},
+#endif
+#endif
+                                          } };
+
+/**
+ * Index of the snapshot owned by the ISRs.
+ */
+static uint8_t isrSnapshot = 0;
+
+/**
+ * Index of the snapshot owned by the thread context.
+ */
+static uint8_t threadSnapshot = 1;
 
-#if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_SAMD) || (defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED))
-    uint16_t delayRelative = delayAbsolute - pinDelay[firstToBeUpdated].delay;
+/**
+ * Index of the latest published snapshot. SNAPSHOT_FRESH flag is set if the ISRs haven't taken it
+ * yet. Both sides only exchange it with their own index, so it works as a lock-free mailbox, also
+ * when the ISRs run on another core (ESP32).
+ */
+static volatile uint8_t publishedSnapshot = 2;
+static const uint8_t SNAPSHOT_FRESH = 0x80;
+
+#ifdef CORE1_ENGINE_AVAILABLE
+/**
+ * Hardware spinlock guarding publishedSnapshot, claimed when core 1 is launched. Before, the ISRs
+ * don't run.
+ */
+static spin_lock_t *snapshotLock = nullptr;
 #endif
 
-#if defined(ARDUINO_ARCH_ESP8266)
-    timer1_attachInterrupt(turn_off_gates_int);
-    timer1_write(US_TO_RTC_TIMER_TICKS(delayRelative));
-#elif defined(ARDUINO_ARCH_ESP32)
-    nextISR = INT_TYPE::TURN_OFF_GATES;
-    setAlarm(delayAbsolute);
-#elif defined(ARDUINO_ARCH_AVR)
-    timerSetCallback(turn_off_gates_int);
-    timerSetAlarm(microsecond2Tick(delayRelative));
-#elif defined(ARDUINO_ARCH_SAMD)
-    timerSetCallback(turn_off_gates_int);
-    timerStart(microsecond2Tick(delayRelative));
-#elif defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)
-    timerSetCallback(turn_off_gates_int);
-    timerStart(delayRelative);
+/**
+ * Store the value into publishedSnapshot and return the previous one, in a single step w.r.t. the
+ * other side. On single-core MCUs it is enough to call it in the ISR or with interrupts disabled.
+ */
+static inline __attribute__((always_inline)) uint8_t exchangePublished(uint8_t value) {
+#ifdef ARDUINO_ARCH_ESP32
+  return __atomic_exchange_n(&publishedSnapshot, value, __ATOMIC_SEQ_CST);
 #else
-    #error "Not implemented"
+#ifdef CORE1_ENGINE_AVAILABLE
+  // Cortex-M0+ has no atomic exchange
+  if (snapshotLock != nullptr) {
+    uint32_t save = spin_lock_blocking(snapshotLock);
+    uint8_t old = publishedSnapshot;
+    publishedSnapshot = value;
+    spin_unlock(snapshotLock, save);
+    return old;
+  }
 #endif
+  uint8_t old = publishedSnapshot;
+  publishedSnapshot = value;
+  return old;
 #endif
-  }
 }
 
-#ifdef FILTER_INT_PERIOD
-// In microsecond
-const static int semiPeriodShrinkMargin = 50;
-const static int semiPeriodExpandMargin = 50;
+/**
+ * Complete the previous memory accesses before the following ones, also as seen by the other core
+ * on ESP32.
+ */
+static inline __attribute__((always_inline)) void memoryBarrier() {
+#if defined(ARDUINO_ARCH_ESP32)
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#elif defined(CORE1_ENGINE_AVAILABLE)
+  __dmb();
+#else
+  __asm__ __volatile__("" ::: "memory");
 #endif
+}
 
-#if defined(FILTER_INT_PERIOD) || defined(MONITOR_FREQUENCY)
-static uint32_t lastTime = 0;
-#endif
+#ifdef BURST_FIRE
+/**
+ * Index of the snapshot published last by the thread context. Its burst-fire pattern is copied
+ * into the next snapshots until a thyristor changes mode or duty, see burstPatternChanged.
+ */
+static uint8_t lastPublishedSnapshot = 0;
+static bool burstPatternChanged = true;
 
-#ifdef MONITOR_FREQUENCY
-// Circular queue to compute the moving average
-static CircularQueue<uint32_t, 5> queue;
-static uint32_t total = 0;
+/**
+ * Semi-period of the burst-fire pattern, owned by the ISRs.
+ */
+static uint16_t burstStep = 0;
 #endif
 
-#if defined(ARDUINO_ARCH_ESP8266)
-void HW_TIMER_IRAM_ATTR zero_cross_int() {
-#elif defined(ARDUINO_ARCH_ESP32)
-void ARDUINO_ISR_ATTR zero_cross_int() {
-#else
-void zero_cross_int() {
-#endif
+/**
+ * Snapshot used by the ISRs in the current semi-period.
+ */
+static const struct Snapshot *snapshot = &snapshots[0];
 
-#if defined(FILTER_INT_PERIOD) || defined(MONITOR_FREQUENCY)
-  if (!lastTime) {
-    lastTime = micros();
-  } else {
-    uint32_t now = micros();
+/**
+ * Tell if zero-cross interrupt is enabled.
+ */
+static volatile bool interruptEnabled = false;
 
-    // "diff" is correct even when timer rolls back, because these values are unsigned
-    uint32_t diff = now - lastTime;
+#ifdef ARDUINO_ARCH_ESP32
+/**
+ * Core serving the zero-cross and timer interrupts, -1 for the one calling Thyristor::begin().
+ */
+static int8_t interruptCore = -1;
 
-#ifdef PRINT_INT_PERIOD
-    if (diff < semiPeriodLength - semiPeriodShrinkMargin) {
+/**
+ * Spinlock guarding the data written by the ISRs and read by the thread context, i.e. the ISR
+ * latency and the statistics.
+ */
+static portMUX_TYPE isrDataLock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+/**
+ * Enter and exit a section of the thread context reading or resetting the data written by the
+ * ISRs. On ESP32, the ISRs may run on the other core (see Thyristor::setInterruptCore(..)), so
+ * disabling the interrupts doesn't exclude them.
+ */
+static inline __attribute__((always_inline)) void lockIsrData() {
 #ifdef ARDUINO_ARCH_ESP32
-      ets_printf("B%d\n", diff);
+  portENTER_CRITICAL(&isrDataLock);
 #else
-      Serial.println(String('B') + diff);
+  noInterrupts();
 #endif
-    }
-    if (diff > semiPeriodLength + semiPeriodExpandMargin) {
+}
+
+static inline __attribute__((always_inline)) void unlockIsrData() {
 #ifdef ARDUINO_ARCH_ESP32
-      ets_printf("A%d\n", diff);
+  portEXIT_CRITICAL(&isrDataLock);
 #else
-      Serial.println(String('A') + diff);
-#endif
-    }
+  interrupts();
 #endif
+}
 
-#ifdef FILTER_INT_PERIOD
-    // Filters out spurious interrupts. The effectiveness of this simple
-    // filter could vary depending on noise on electrical networ.
-    if (diff < semiPeriodLength - semiPeriodShrinkMargin) { return; }
+/**
+ * The same, in the ISRs writing that data. They already exclude the thread context of their core.
+ */
+static inline __attribute__((always_inline)) void lockIsrDataFromIsr() {
+#ifdef ARDUINO_ARCH_ESP32
+  portENTER_CRITICAL_ISR(&isrDataLock);
 #endif
+}
 
+static inline __attribute__((always_inline)) void unlockIsrDataFromIsr() {
+#ifdef ARDUINO_ARCH_ESP32
+  portEXIT_CRITICAL_ISR(&isrDataLock);
 #endif
+}
 
-#if defined(ARDUINO_ARCH_AVR)
-    // Early timer start, only for avr. This is necessary since the instructions executed in this
-    // ISR take much time (more than 30us with only 4 dimmers). Before the end of this ISR, either
-    // the timer is stop or the alarm time is properly set.
-    timerStartAndTrigger(microsecond2Tick(15000));
-#endif
+#ifdef CORE1_ENGINE_AVAILABLE
+/**
+ * Tell if core 0 asked core 1 to attach the zero-cross interrupt, which is served by the core
+ * attaching it.
+ */
+static volatile bool attachRequested = false;
 
-#if defined(FILTER_INT_PERIOD) || defined(MONITOR_FREQUENCY)
-#ifdef MONITOR_FREQUENCY
-    // if diff is very very greater than the theoretical value, the electrical signal
-    // can be considered as lost for a while and I must reset my moving average.
-    // I decided to use "16" because is a power of 2, very fast to be computed.
-    if (semiPeriodLength && diff > semiPeriodLength * 16) {
-      queue.reset();
-      total = 0;
-    } else {
-      // If filtering has passed, I can update the moving average
-      uint32_t valueToRemove = queue.insert(diff);
-      total += diff;
-      total -= valueToRemove;
-    }
+/**
+ * Tell if core 1 has allocated the interrupts.
+ */
+static volatile bool core1Ready = false;
 #endif
 
-    lastTime = now;
-  }
+/**
+ * Number of events already managed in the current semi-period.
+ */
+static thyristor_count_t eventManaged = 0;
+
+/**
+ * maxLatencySample converted to timer ticks.
+ */
+static timer_ticks_t maxLatencyTicks = 0;
+
+#ifdef ZC_CAPTURE_AVAILABLE
+/**
+ * Tell if the zero-cross edges are timestamped by the input capture of the timer.
+ */
+static bool zcCaptured = false;
+
+/**
+ * log2 of timer ticks per microsecond.
+ */
+static uint8_t ticksPerMicroShift = 0;
 #endif
 
-  // Turn OFF all the thyristors, even if always ON.
-  // This is to speed up transitions between ON to OFF state:
-  // If I don't turn OFF all those thyristors, I must wait
-  // a semiperiod to turn off those one.
-  for (int i = 0; i < Thyristor::nThyristors; i++) { digitalWrite(pinDelay[i].pin, LOW); }
+#ifdef PIO_ENGINE_AVAILABLE
+/**
+ * Tell if the zero crossings are served by the PIO engine, instead of the ISRs.
+ */
+static bool pioEngineRunning = false;
 
-#ifdef CHECK_MANAGED_THYR
-  if (thyristorManaged != Thyristor::nThyristors) {
-#ifdef ARDUINO_ARCH_ESP32
-    ets_printf("E%d\n", thyristorManaged);
-#else
-    Serial.print("E");
-    Serial.println(thyristorManaged);
+/**
+ * Return the bit of the pin in the levels of the PIO engine, 0 if not a GPIO.
+ */
+static uint32_t pioLevel(uint8_t pin) {
+  return pin < 32 ? (uint32_t)1 << pin : 0;
+}
 #endif
-  }
+
+#ifdef ZC_PLL
+// Half width of the window around the predicted zero crossing where the edges are accepted, in
+// microseconds.
+static const uint16_t pllWindow = 400;
+
+// Number of consecutive missing edges synthesized before considering the zero-cross signal lost.
+static const uint8_t pllMaxMissed = 10;
+
+// Loop gains, as power of 2 divisors of the phase error: each semi-period the phase is corrected by
+// error / 2^pllPhaseShift and the period by error / 2^pllFrequencyShift.
+static const uint8_t pllPhaseShift = 1;
+static const uint8_t pllFrequencyShift = 5;
+
+// Fractional bits of the estimated period.
+static const uint8_t pllFractionBits = 8;
+
+#ifdef ZC_DECIMATION
+// Semi-periods tracked one by one, with the loop gains above, after the lock and after an edge
+// farther than pllSettleError microseconds from the prediction. Then the loop has settled, and the
+// decimated edges cannot drift out of pllWindow.
+static const uint8_t pllSettleLength = 255;
+static const uint16_t pllSettleError = 100;
+
+// Loop gain of the period while decimating, as power of 2 divisor of the phase error of a tracked
+// edge. The correction is spread over the ZC_DECIMATION semi-periods up to the next tracked edge,
+// so the gain doesn't depend on ZC_DECIMATION.
+static const uint8_t pllDecimatedFrequencyShift = 4;
 #endif
 
-  // Update the structures and set thresholds, if needed
-  if (Thyristor::newDelayValues && !Thyristor::updatingStruct) {
-    Thyristor::newDelayValues = false;
-    alwaysOffCounter = 0;
-    alwaysOnCounter = 0;
-    for (int i = 0; i < Thyristor::nThyristors; i++) {
-      pinDelay[i].pin = Thyristor::thyristors[i]->pin;
-      // Rounding delays to avoid error and unexpected behavior due to
-      // non-ideal thyristors and not perfect sine wave
-      if (Thyristor::thyristors[i]->delay == 0) {
-        alwaysOnCounter++;
-        pinDelay[i].delay = 0;
-      } else if (Thyristor::thyristors[i]->delay < startMargin) {
-        alwaysOnCounter++;
-        pinDelay[i].delay = 0;
-      } else if (Thyristor::thyristors[i]->delay == semiPeriodLength) {
-        alwaysOffCounter++;
-        pinDelay[i].delay = semiPeriodLength;
-      } else if (Thyristor::thyristors[i]->delay > semiPeriodLength - endMargin) {
-        alwaysOffCounter++;
-        pinDelay[i].delay = semiPeriodLength;
-      } else {
-        pinDelay[i].delay = Thyristor::thyristors[i]->delay;
-      }
-    }
-    _allThyristorsOnOff = Thyristor::allThyristorsOnOff;
-  }
+/**
+ * pllWindow converted to timer ticks.
+ */
+static timer_ticks_t pllWindowTicks = 0;
 
-  thyristorManaged = 0;
+#ifdef ZC_DECIMATION
+/**
+ * pllSettleError converted to timer ticks.
+ */
+static timer_ticks_t pllSettleErrorTicks = 0;
+#endif
 
-  // if all are on and off, I can disable the zero cross interrupt
-  if (_allThyristorsOnOff) {
-    for (int i = 0; i < Thyristor::nThyristors; i++) {
-      if (pinDelay[i].delay == semiPeriodLength) {
-        digitalWrite(pinDelay[i].pin, LOW);
-      } else {
-        digitalWrite(pinDelay[i].pin, HIGH);
-      }
-      thyristorManaged++;
+/**
+ * Nominal semi-period in timer ticks, it is updated by Thyristor::publishSnapshot().
+ */
+static timer_ticks_t pllNominalPeriod = 0;
+
+/**
+ * True if the timebase is locked on the zero-cross signal, i.e. the timer starts the semi-periods.
+ */
+static bool pllLocked = false;
+
+/**
+ * Estimated semi-period in timer ticks, fixed point with pllFractionBits.
+ */
+static uint32_t pllPeriod = 0;
+
+/**
+ * Fraction of tick of the estimated period not yet applied to the semi-periods, so the rounding
+ * doesn't accumulate between the edges (e.g. with ZC_DECIMATION).
+ */
+static uint16_t pllPhaseFraction = 0;
+
+/**
+ * Ticks from the start of the current semi-period to the start of the next one.
+ */
+static timer_ticks_t pllNextStart = 0;
+
+/**
+ * Phase error of the last accepted edge, in ticks, not yet applied: positive if the edge came after
+ * the start of the semi-period.
+ */
+static int32_t pllError = 0;
+
+/**
+ * Tell if the edge of the current semi-period, or of the next one, has been accepted.
+ */
+static bool pllEdgeSeen = false;
+static bool pllEdgeNext = false;
+
+/**
+ * Number of consecutive synthesized edges.
+ */
+static uint8_t pllMissed = 0;
+
+#ifdef ZC_SINGLE_EDGE
+/**
+ * True during the semi-periods not starting with an edge.
+ */
+static bool pllOddSemiPeriod = false;
+#endif
+
+#ifdef ZC_DECIMATION
+/**
+ * Index of the current semi-period modulo ZC_DECIMATION, the zero crossing starting the semi-period
+ * 0 is tracked.
+ */
+static uint8_t pllDecimationCount = 0;
+
+/**
+ * True in the semi-periods around the tracked zero crossing, i.e. ZC_DECIMATION - 1 and 0, when
+ * the zero-cross interrupts are served.
+ */
+static volatile bool pllSampling = true;
+
+/**
+ * Semi-periods still tracked one by one, see pllSettleLength.
+ */
+static uint8_t pllSettling = pllSettleLength;
+#endif
+
+void semi_period_int();
+#endif
+
+/**
+ * Convert microseconds to the ticks of the timer used by this library.
+ */
+static timer_ticks_t microsecond2TimerTicks(uint16_t micro) {
+#if defined(ARDUINO_ARCH_ESP8266)
+  return US_TO_RTC_TIMER_TICKS(micro);
+#elif defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_SAMD)
+  return microsecond2Tick(micro);
+#else
+  // ESP32, RP2040 and native timers count microseconds
+  return micro;
+#endif
+}
+
+#if defined(ARDUINO_ARCH_ESP8266)
+/**
+ * FRC1 timer can only count down from a relative value, so the time elapsed from the zero cross is
+ * measured through the CPU cycle counter, latched at the zero cross.
+ */
+static uint32_t originCycles = 0;
+
+/**
+ * log2 of CPU cycles per FRC1 tick (FRC1 is clocked at 80MHz / 16).
+ */
+static uint8_t cyclesPerTickShift = 4;
+
+/**
+ * The shortest FRC1 timer countdown, as suggested by ESP8266 API documentation.
+ */
+static const timer_ticks_t minTimerTicks = US_TO_RTC_TIMER_TICKS(10);
+
+static inline __attribute__((always_inline)) uint32_t cycleCount() {
+  uint32_t ccount;
+  __asm__ __volatile__("rsr %0,ccount" : "=a"(ccount));
+  return ccount;
+}
+#endif
+
+#ifdef ISR_STATS
+static Thyristor::Stats stats;
+
+/**
+ * Time of the last zero-cross interrupt, in microseconds.
+ */
+static uint32_t lastZeroCross = 0;
+
+/**
+ * Return the current value of the clock used to profile the ISRs. On SAMD and RP2040 it is the
+ * SysTick counter, which counts down.
+ */
+static inline __attribute__((always_inline)) uint32_t profileClock() {
+#if defined(ARDUINO_ARCH_ESP8266)
+  return cycleCount();
+#elif defined(ARDUINO_ARCH_ESP32)
+  return ESP.getCycleCount();
+#elif defined(ARDUINO_ARCH_AVR)
+  // Timer0 is configured by Arduino core with prescaler 64
+  return TCNT0;
+#elif defined(ARDUINO_ARCH_SAMD)
+  return SysTick->VAL;
+#elif defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)
+  return systick_hw->cvr;
+#elif defined(ARDUINO_ARCH_NATIVE)
+  return nativeCycleCount();
+#endif
+}
+
+/**
+ * Return the CPU cycles elapsed from the given value of profileClock(). The time must be shorter
+ * than the period of the clock: 1ms on AVR, the SysTick reload period on SAMD (1ms) and RP2040.
+ */
+static inline __attribute__((always_inline)) uint32_t profileCycles(uint32_t start) {
+#if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_NATIVE)
+  return profileClock() - start;
+#elif defined(ARDUINO_ARCH_AVR)
+  return (uint32_t)(uint8_t)(TCNT0 - start) << 6;
+#elif defined(ARDUINO_ARCH_SAMD)
+  uint32_t now = SysTick->VAL;
+  return now <= start ? start - now : start + SysTick->LOAD + 1 - now;
+#elif defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)
+  uint32_t now = systick_hw->cvr;
+  return now <= start ? start - now : start + systick_hw->rvr + 1 - now;
+#endif
+}
+
+#if defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)
+/**
+ * Run SysTick of the calling core from the CPU clock with the longest period, unless already in
+ * use.
+ */
+static void beginSysTick() {
+  if (!(systick_hw->csr & 1)) {
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0b101;
+  }
+}
+#endif
+
+/**
+ * Measure the execution time of a routine, from the declaration to the end of the scope.
+ */
+class IsrProfiler {
+public:
+  inline __attribute__((always_inline)) IsrProfiler(Thyristor::IsrProfile &profile)
+    : profile(profile), start(profileClock()) {}
+
+  inline __attribute__((always_inline)) ~IsrProfiler() {
+    uint32_t cycles = profileCycles(start);
+    uint8_t bin = 0;
+    uint32_t scaled = cycles >> 6;
+    while (scaled && bin < ISR_STATS_BINS - 1) {
+      scaled >>= 1;
+      bin++;
     }
 
-#if defined(MONITOR_FREQUENCY)
-    if (!Thyristor::frequencyMonitorAlwaysEnabled) {
-      interruptEnabled = false;
-      detachInterrupt(digitalPinToInterrupt(Thyristor::syncPin));
+    lockIsrDataFromIsr();
+    profile.count++;
+    if (cycles < profile.minCycles) { profile.minCycles = cycles; }
+    if (cycles > profile.maxCycles) { profile.maxCycles = cycles; }
+    profile.histogram[bin]++;
+    unlockIsrDataFromIsr();
+  }
+
+private:
+  Thyristor::IsrProfile &profile;
+  uint32_t start;
+};
+
+#define PROFILE_ISR(profile) IsrProfiler isrProfiler(stats.profile)
+#else
+#define PROFILE_ISR(profile)
+#endif
+
+#ifdef GATE_TRACE
+static_assert((GATE_TRACE_SIZE & (GATE_TRACE_SIZE - 1)) == 0, "GATE_TRACE_SIZE must be a power of 2");
 
-      queue.reset();
-      total = 0;
+// The indexes of the trace buffer must be accessed atomically
+#if defined(ARDUINO_ARCH_AVR)
+typedef uint8_t trace_index_t;
+static_assert(GATE_TRACE_SIZE <= 128, "GATE_TRACE_SIZE must be lower or equal than 128 on AVR");
+#else
+typedef uint16_t trace_index_t;
+static_assert(GATE_TRACE_SIZE <= 32768, "GATE_TRACE_SIZE must be lower or equal than 32768");
+#endif
+
+static Thyristor::TraceRecord traceBuffer[GATE_TRACE_SIZE];
+
+/**
+ * Free-running indexes of the next record to be written by the ISRs and to be read by the thread
+ * context. Each index is modified only by its owner, so no lock is needed.
+ */
+static volatile trace_index_t traceHead = 0;
+static volatile trace_index_t traceTail = 0;
+
+static volatile bool traceEnabled = false;
+
+/**
+ * Records dropped because the buffer was full, they are reported by a TRACE_DROPPED record as soon
+ * as there is room again. It is owned by the ISRs.
+ */
+static uint32_t traceDropped = 0;
+
+#if defined(ARDUINO_ARCH_ESP8266)
+static void HW_TIMER_IRAM_ATTR tracePush(Thyristor::TraceType type, uint64_t pins) {
+#elif defined(ARDUINO_ARCH_ESP32)
+static void ARDUINO_ISR_ATTR tracePush(Thyristor::TraceType type, uint64_t pins) {
+#else
+static void tracePush(Thyristor::TraceType type, uint64_t pins) {
+#endif
+  uint32_t now = micros();
+  trace_index_t head = traceHead;
+  trace_index_t available = GATE_TRACE_SIZE - (trace_index_t)(head - traceTail);
+
+  if (traceDropped) {
+    if (available < 2) {
+      traceDropped++;
+      return;
+    }
+    Thyristor::TraceRecord &record = traceBuffer[head & (GATE_TRACE_SIZE - 1)];
+    record.pins = traceDropped;
+    record.time = now;
+    record.type = Thyristor::TRACE_DROPPED;
+    head++;
+    traceDropped = 0;
+  } else if (available == 0) {
+    traceDropped = 1;
+    return;
+  }
+
+  Thyristor::TraceRecord &record = traceBuffer[head & (GATE_TRACE_SIZE - 1)];
+  record.pins = pins;
+  record.time = now;
+  record.type = type;
+
+  // The record must be complete before the reader can see it
+  __asm__ __volatile__("" ::: "memory");
+  traceHead = head + 1;
+}
+
+#define TRACE_EVENT(type)                                                                          \
+  if (traceEnabled) { tracePush(Thyristor::type, 0); }
+#define TRACE_GATES(type, gatePins)                                                                \
+  if (traceEnabled && (gatePins)) { tracePush(Thyristor::type, gatePins); }
+#else
+#define TRACE_EVENT(type)
+#define TRACE_GATES(type, gatePins)
+#endif
+
+/**
+ * Latch the zero cross as origin of the schedule, *age* ticks ago.
+ */
+static inline __attribute__((always_inline)) void startSchedule(timer_ticks_t age) {
+#if defined(ARDUINO_ARCH_ESP8266)
+  originCycles = cycleCount() - ((uint32_t)age << cyclesPerTickShift);
+#elif defined(ARDUINO_ARCH_ESP32)
+  startTimer(age);
+#elif defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_SAMD)                                     \
+  || (defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)) || defined(ARDUINO_ARCH_NATIVE)
+  timerStart(age);
+#else
+#error "Not implemented"
+#endif
+}
+
+/**
+ * Return the ticks elapsed from the zero cross.
+ */
+static inline __attribute__((always_inline)) timer_ticks_t elapsedTicks() {
+#if defined(ARDUINO_ARCH_ESP8266)
+  return (cycleCount() - originCycles) >> cyclesPerTickShift;
+#elif defined(ARDUINO_ARCH_ESP32)
+  return readTimer();
+#elif defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_SAMD)                                     \
+  || (defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)) || defined(ARDUINO_ARCH_NATIVE)
+  return timerRead();
+#else
+#error "Not implemented"
+#endif
+}
+
+/**
+ * Return the ticks from the origin of the schedule to the zero-cross edge being served. Without
+ * the input capture, the edge is timestamped now.
+ */
+static inline __attribute__((always_inline)) timer_ticks_t edgeTicks() {
+#ifdef ZC_CAPTURE_AVAILABLE
+  if (zcCaptured) { return timerCaptureRead(); }
+#endif
+  return elapsedTicks();
+}
+
+/**
+ * Return the ticks elapsed from the zero-cross edge being served, 0 without the input capture.
+ */
+static inline __attribute__((always_inline)) timer_ticks_t edgeAge() {
+#ifdef ZC_CAPTURE_AVAILABLE
+  if (zcCaptured) { return elapsedTicks() - timerCaptureRead(); }
+#endif
+  return 0;
+}
+
+/**
+ * Arm the timer for an event happening *ticks* after the zero cross. Return false if that time is
+ * already passed (e.g. a previous ISR took too long), then the caller must serve the event
+ * immediately.
+ */
+static inline __attribute__((always_inline)) bool armTimer(timer_ticks_t ticks) {
+#if defined(ARDUINO_ARCH_ESP8266)
+  timer_ticks_t elapsed = elapsedTicks();
+  bool armed = elapsed < ticks;
+  if (armed) {
+    uint32_t remaining = ticks - elapsed;
+    timer1_write(remaining < minTimerTicks ? minTimerTicks : remaining);
+  }
+#elif defined(ARDUINO_ARCH_ESP32)
+  bool armed = setAlarm(ticks);
+#elif defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_SAMD)                                     \
+  || (defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)) || defined(ARDUINO_ARCH_NATIVE)
+  bool armed = timerSetAlarm(ticks);
+#else
+#error "Not implemented"
+#endif
+#ifdef ISR_STATS
+  if (!armed) {
+    lockIsrDataFromIsr();
+    stats.lateEvents++;
+    unlockIsrDataFromIsr();
+  }
+#endif
+  return armed;
+}
+
+/**
+ * Set the routine served by the next timer interrupt.
+ */
+static inline __attribute__((always_inline)) void setNextISR(void (*isr)()) {
+#if defined(ARDUINO_ARCH_ESP8266)
+  timer1_attachInterrupt(isr);
+#elif defined(ARDUINO_ARCH_ESP32)
+  nextISR = isr;
+#else
+  timerSetCallback(isr);
+#endif
+}
+
+/**
+ * Stop the timer when the schedule is over.
+ */
+static inline __attribute__((always_inline)) void stopSchedule() {
+#if defined(ARDUINO_ARCH_ESP8266)
+  // Given the Arduino HAL and esp8266 technical reference manual,
+  // when timer triggers, the counter stops because it has reached zero
+  // and no-autorealod was set (this timer can only down-count).
+#elif defined(ARDUINO_ARCH_ESP32)
+  stopTimer();
+#elif defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_SAMD) || defined(ARDUINO_ARCH_NATIVE)
+  timerStop();
+#elif defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)
+  // Timer callback is not rescheduled
+#endif
+}
+
+/**
+ * Convert a time from the actual zero crossing of the voltage into the ticks from the zero-cross
+ * interrupt, compensating the detector offset and the ISR latency. The time is bounded to [0; max]
+ * microseconds.
+ */
+static timer_ticks_t compensatedTicks(uint16_t micro, uint16_t max, timer_ticks_t latency) {
+  int32_t t = (int32_t)micro - zeroCrossOffset;
+  if (t < 0) {
+    t = 0;
+  } else if (t > max) {
+    t = max;
+  }
+  timer_ticks_t ticks = microsecond2TimerTicks(t);
+  return ticks > latency ? ticks - latency : 0;
+}
+
+/**
+ * Raise the gates in the given range of writes.
+ */
+static inline __attribute__((always_inline)) void setGates(const struct GpioRange &range) {
+  for (thyristor_count_t i = range.first; i < range.last; i++) {
+    gpioSet(snapshot->writes[i].port, snapshot->writes[i].mask);
+  }
+}
+
+/**
+ * Lower the gates in the given range of writes.
+ */
+static inline __attribute__((always_inline)) void clearGates(const struct GpioRange &range) {
+  for (thyristor_count_t i = range.first; i < range.last; i++) {
+    gpioClear(snapshot->writes[i].port, snapshot->writes[i].mask);
+  }
+}
+
+/**
+ * Append the writes to drive the gates of thyristors [from; to) in the given arrays of ports and
+ * masks. The pins on the same port are merged in a single write.
+ */
+static struct GpioRange appendGates(struct Snapshot &s, thyristor_count_t &nWrites,
+                                    const gpio_port_t ports[], const gpio_mask_t masks[], int from,
+                                    int to) {
+  struct GpioRange range = { nWrites, nWrites };
+  for (int i = from; i < to; i++) {
+    // No gate to drive, e.g. it is fired by an output compare channel (see HW_COMPARE_GATES)
+    if (masks[i] == 0) { continue; }
+    thyristor_count_t j = range.first;
+    while (j < nWrites && s.writes[j].port != ports[i]) { j++; }
+    if (j == nWrites) {
+      s.writes[j].port = ports[i];
+      s.writes[j].mask = 0;
+      nWrites++;
+    }
+    s.writes[j].mask |= masks[i];
+  }
+  range.last = nWrites;
+  return range;
+}
+
+/**
+ * Called when the events of the semi-period are over: stop the timer or, if the timebase is locked,
+ * arm it to start the next semi-period.
+ */
+static inline __attribute__((always_inline)) void endSchedule() {
+#ifdef ZC_PLL
+  if (pllLocked) {
+    setNextISR(semi_period_int);
+    if (!armTimer(pllNextStart)) { semi_period_int(); }
+    return;
+  }
+#endif
+  stopSchedule();
+}
+
+#if defined(ARDUINO_ARCH_ESP8266)
+void HW_TIMER_IRAM_ATTR turn_off_gates_int() {
+#elif defined(ARDUINO_ARCH_ESP32)
+void ARDUINO_ISR_ATTR turn_off_gates_int() {
+#else
+void turn_off_gates_int() {
+#endif
+  PROFILE_ISR(turnOff);
+
+  // The gates of the thyristors always on are not part of the gate-off event
+  clearGates(snapshot->events[snapshot->nEvents].gates);
+  TRACE_GATES(TRACE_GATES_LOW, snapshot->events[snapshot->nEvents].pins);
+#ifdef COMPARE_GATES_AVAILABLE
+  timerCompareClear(snapshot->compareOffChannels);
+#endif
+
+  endSchedule();
+}
+
+/**
+ * Turn on the thyristors of the current event. If the next event is already due, serve it
+ * immediately, otherwise arm the timer.
+ */
+static inline __attribute__((always_inline)) void serveEvents() {
+  // If the next event is already due, serve it in this same interrupt
+  for (;;) {
+    const struct FiringEvent *event = &snapshot->events[eventManaged];
+#ifdef PREDEFINED_PULSE_LENGTH
+    if (event->off) {
+      clearGates(event->gates);
+      TRACE_GATES(TRACE_GATES_LOW, event->pins);
+    } else
+#endif
+    {
+      setGates(event->gates);
+      TRACE_GATES(TRACE_GATES_HIGH, event->pins);
+    }
+    eventManaged++;
+
+    event++;
+    if (eventManaged < snapshot->nEvents) {
+      if (armTimer(event->ticks)) { return; }
+    } else {
+#ifdef PREDEFINED_PULSE_LENGTH
+      // The last pulse is over, I can stop timer. Energy saving?
+      endSchedule();
+#else
+      // If there are not more thyristors to serve, set timer to turn off gates' signal
+      setNextISR(turn_off_gates_int);
+      if (!armTimer(event->ticks)) { turn_off_gates_int(); }
+#endif
+      return;
+    }
+  }
+}
+
+/**
+ * Timer routine to turn on one or more thyristors. This function may be be called multiple times
+ * per semi-period depending on the current thyristors configuration.
+ */
+#if defined(ARDUINO_ARCH_ESP8266)
+void HW_TIMER_IRAM_ATTR activate_thyristors() {
+#elif defined(ARDUINO_ARCH_ESP32)
+void ARDUINO_ISR_ATTR activate_thyristors() {
+#else
+void activate_thyristors() {
+#endif
+  PROFILE_ISR(activate);
+
+  // Measure how late this ISR is w.r.t. the event, the next schedules are anticipated accordingly
+  timer_ticks_t elapsed = elapsedTicks();
+  timer_ticks_t ticks = snapshot->events[eventManaged].ticks;
+  timer_ticks_t sample = elapsed > ticks ? elapsed - ticks : 0;
+  lockIsrDataFromIsr();
+  if (sample <= maxLatencyTicks) {
+    filteredLatency = filteredLatency - (filteredLatency >> latencyFilterShift) + sample;
+  }
+#ifdef ISR_STATS
+  else {
+    stats.overruns++;
+  }
+#endif
+  unlockIsrDataFromIsr();
+
+#ifdef ADAPTIVE_MERGE_PERIOD
+  const thyristor_count_t first = eventManaged;
+#endif
+  serveEvents();
+#ifdef ADAPTIVE_MERGE_PERIOD
+  // The samples of the interrupts serving more events would include the late ones
+  if (eventManaged == first + 1) {
+    sample = elapsedTicks() - ticks;
+    if (sample <= maxLatencyTicks) {
+      filteredEventCost = filteredEventCost - (filteredEventCost >> latencyFilterShift) + sample;
+    }
+  }
+#endif
+}
+
+#ifdef ADAPTIVE_MERGE_PERIOD
+static volatile uint8_t probeCount = 0;
+static timer_ticks_t probeTicks = 0;
+static timer_ticks_t probeCost = 0;
+
+/**
+ * Timer routine doing the work of an event, to measure its cost before any zero cross: it writes
+ * the gates (with empty masks, so their level doesn't change) and it arms the timer for the next
+ * probe. The worst cost is kept.
+ */
+#if defined(ARDUINO_ARCH_ESP8266)
+void HW_TIMER_IRAM_ATTR merge_probe_int() {
+#elif defined(ARDUINO_ARCH_ESP32)
+void ARDUINO_ISR_ATTR merge_probe_int() {
+#else
+void merge_probe_int() {
+#endif
+  const struct Snapshot &s = snapshots[publishedSnapshot & ~SNAPSHOT_FRESH];
+  for (thyristor_count_t i = s.allGates.first; i < s.allGates.last; i++) {
+    gpioSet(s.writes[i].port, 0);
+  }
+
+  const timer_ticks_t due = probeTicks;
+  probeCount++;
+  if (probeCount < mergeProbes) {
+    probeTicks += microsecond2TimerTicks(mergeProbeInterval);
+    if (armTimer(probeTicks)) {
+      timer_ticks_t cost = elapsedTicks() - due;
+      if (cost > probeCost) { probeCost = cost; }
+      return;
+    }
+    // This probe took longer than the interval, the next one would be late: stop here
+    probeCount = mergeProbes;
+  }
+  stopSchedule();
+}
+
+/**
+ * Size the Merge Period on the filtered cost of an event.
+ */
+static void updateMergePeriod() {
+  noInterrupts();
+  uint32_t cost = filteredEventCost >> latencyFilterShift;
+  interrupts();
+  cost = cost * 1000 / microsecond2TimerTicks(1000);
+  cost += (cost + 3) / 4 + mergePeriodGuard;
+
+  if (cost < minMergePeriod) {
+    mergePeriod = minMergePeriod;
+  } else if (cost > maxMergePeriod) {
+    mergePeriod = maxMergePeriod;
+  } else {
+    mergePeriod = cost;
+  }
+}
+#endif
+
+#ifdef FILTER_INT_PERIOD
+// In microsecond
+const static int semiPeriodShrinkMargin = 50;
+const static int semiPeriodExpandMargin = 50;
+#endif
+
+#if defined(FILTER_INT_PERIOD) || defined(MONITOR_FREQUENCY)
+static uint32_t lastTime = 0;
+#endif
+
+#ifdef MONITOR_FREQUENCY
+// Number of semi-period samples considered by the frequency monitor, it must be a power of 2.
+#ifndef MONITOR_FREQUENCY_WINDOW
+#define MONITOR_FREQUENCY_WINDOW 8
+#endif
+
+// Estimator of the frequency monitor, by default it is the moving average of the samples.
+// Select at most one among the following alternatives:
+// - MONITOR_FREQUENCY_TRIMMED_MEAN: average of the central half of the sorted samples, robust
+//   against outliers (e.g. spurious or missing zero-cross edges). It needs at least 4 samples.
+// - MONITOR_FREQUENCY_IIR: exponential moving average with weight 1/MONITOR_FREQUENCY_WINDOW, it
+//   doesn't store the samples.
+//#define MONITOR_FREQUENCY_TRIMMED_MEAN
+//#define MONITOR_FREQUENCY_IIR
+
+#if defined(MONITOR_FREQUENCY_TRIMMED_MEAN) && defined(MONITOR_FREQUENCY_IIR)
+#error "Select at most one estimator for the frequency monitor"
+#endif
+
+#ifdef MONITOR_FREQUENCY_IIR
+static_assert((MONITOR_FREQUENCY_WINDOW & (MONITOR_FREQUENCY_WINDOW - 1)) == 0,
+              "MONITOR_FREQUENCY_WINDOW must be a power of 2");
+
+// Filtered semi-period multiplied by MONITOR_FREQUENCY_WINDOW, in microseconds
+static uint32_t filteredSemiPeriod = 0;
+
+// Number of samples, saturated to MONITOR_FREQUENCY_WINDOW
+static uint8_t nSamples = 0;
+#else
+// Circular queue of the semi-period samples, in microseconds
+static CircularQueue<uint16_t, MONITOR_FREQUENCY_WINDOW> queue;
+#ifndef MONITOR_FREQUENCY_TRIMMED_MEAN
+static uint32_t total = 0;
+#endif
+#endif
+
+/**
+ * Forget the samples of the frequency monitor.
+ */
+static void resetFrequencyMonitor() {
+#ifdef MONITOR_FREQUENCY_IIR
+  filteredSemiPeriod = 0;
+  nSamples = 0;
+#else
+  queue.reset();
+#ifndef MONITOR_FREQUENCY_TRIMMED_MEAN
+  total = 0;
+#endif
+#endif
+}
+
+/**
+ * Add a semi-period sample (in microseconds) to the frequency monitor. It is O(1).
+ */
+static inline __attribute__((always_inline)) void addFrequencySample(uint32_t sample) {
+  if (sample > 0xFFFF) { sample = 0xFFFF; }
+#ifdef MONITOR_FREQUENCY_IIR
+  if (nSamples == 0) {
+    filteredSemiPeriod = sample * MONITOR_FREQUENCY_WINDOW;
+  } else {
+    filteredSemiPeriod = filteredSemiPeriod - filteredSemiPeriod / MONITOR_FREQUENCY_WINDOW + sample;
+  }
+  if (nSamples < MONITOR_FREQUENCY_WINDOW) { nSamples++; }
+#else
+  uint16_t valueToRemove = queue.insert(sample);
+#ifndef MONITOR_FREQUENCY_TRIMMED_MEAN
+  total += sample;
+  total -= valueToRemove;
+#else
+  (void)valueToRemove;
+#endif
+#endif
+}
+#endif
+
+/**
+ * Start a semi-period: take the latest snapshot, drive the gates of the thyristors always on, and
+ * arm the timer for the first event.
+ */
+#if defined(ARDUINO_ARCH_ESP8266)
+void HW_TIMER_IRAM_ATTR start_semi_period() {
+#elif defined(ARDUINO_ARCH_ESP32)
+void ARDUINO_ISR_ATTR start_semi_period() {
+#else
+void start_semi_period() {
+#endif
+#ifdef CHECK_MANAGED_THYR
+  if (eventManaged != snapshot->nEvents) {
+#ifdef ARDUINO_ARCH_ESP32
+    ets_printf("E%d\n", eventManaged);
+#else
+    Serial.print("E");
+    Serial.println(eventManaged);
+#endif
+  }
+#endif
+
+#ifdef ISR_STATS
+  lockIsrDataFromIsr();
+  stats.semiPeriods++;
+  if (eventManaged != snapshot->nEvents) { stats.unmanagedSemiPeriods++; }
+  unlockIsrDataFromIsr();
+#endif
+
+  // Take the latest snapshot, if any. Thyristor::publishSnapshot() may exchange the index meanwhile
+  // only from another core, then the exchange returns its snapshot, still fresh.
+  uint8_t published = publishedSnapshot;
+  if (published & SNAPSHOT_FRESH) {
+    published = exchangePublished(isrSnapshot);
+    isrSnapshot = published & ~SNAPSHOT_FRESH;
+    snapshot = &snapshots[isrSnapshot];
+  }
+  TRACE_EVENT(TRACE_SEMI_PERIOD);
+
+  // Turn OFF all the thyristors, even if always ON.
+  // This is to speed up transitions between ON to OFF state:
+  // If I don't turn OFF all those thyristors, I must wait
+  // a semiperiod to turn off those one.
+  clearGates(snapshot->allGates);
+  TRACE_GATES(TRACE_GATES_LOW, snapshot->allPins);
+
+  // Turn on thyristors with 0 delay (always on)
+  setGates(snapshot->alwaysOnGates);
+  TRACE_GATES(TRACE_GATES_HIGH, snapshot->alwaysOnPins);
+
+#ifdef BURST_FIRE
+  // The thyristors in burst-fire mode conduct this whole semi-period, or not at all, as precomputed
+  // by the pattern: a write per port, whatever the number of thyristors.
+  if (snapshot->burstLength) {
+    if (burstStep >= snapshot->burstLength) { burstStep = 0; }
+    const gpio_mask_t *row = &snapshot->burstMasks[burstStep * snapshot->nBurstPorts];
+    for (thyristor_count_t i = 0; i < snapshot->nBurstPorts; i++) {
+      gpioSet(snapshot->burstPorts[i], row[i]);
+    }
+#ifdef GATE_TRACE
+    uint64_t pins = 0;
+    for (thyristor_count_t i = 0; i < snapshot->nBurstGates; i++) {
+      const struct BurstGate &gate = snapshot->burstGates[i];
+      if (row[gate.port] & gate.mask) { pins |= gate.pins; }
+    }
+    TRACE_GATES(TRACE_GATES_HIGH, pins);
+#endif
+    burstStep++;
+  }
+#endif
+
+#ifdef COMPARE_GATES_AVAILABLE
+  // The same for the gates on the output compare channels, then the timer fires them on its own
+  timerCompareClear(snapshot->compareChannels);
+  for (uint8_t i = 0; i < snapshot->nCompareFirings; i++) {
+    timerCompareFire(snapshot->compareFirings[i].channel, snapshot->compareFirings[i].ticks);
+  }
+#endif
+
+  eventManaged = 0;
+
+  // if all are on and off, I can disable the zero cross interrupt
+  if (snapshot->allThyristorsOnOff) {
+#ifdef ZC_PLL
+    pllLocked = false;
+#endif
+    stopSchedule();
+
+#if defined(MONITOR_FREQUENCY)
+    if (!Thyristor::frequencyMonitorAlwaysEnabled && Thyristor::disableInterrupt()) {
+      resetFrequencyMonitor();
 
       lastTime = 0;
     }
 #elif defined(FILTER_INT_MONITOR)
     lastTime = 0;
-    interruptEnabled = false;
-    detachInterrupt(digitalPinToInterrupt(Thyristor::syncPin));
+    Thyristor::disableInterrupt();
 #else
-    interruptEnabled = false;
-    detachInterrupt(digitalPinToInterrupt(Thyristor::syncPin));
+    Thyristor::disableInterrupt();
 #endif
 
     return;
   }
 
-  // Turn on thyristors with 0 delay (always on)
-  while (thyristorManaged < Thyristor::nThyristors && pinDelay[thyristorManaged].delay == 0) {
-    digitalWrite(pinDelay[thyristorManaged].pin, HIGH);
-    thyristorManaged++;
-  }
-
-  // This block of code is inteded to manage the case near to the next semi-period:
-  // In this case we should avoid to trigger the timer, because the effective semiperiod
-  // perceived by the esp8266 could be less than 10000microsecond. This could be due to
-  // the relative time (there is no possibily to set the timer to an absolute time)
-  // Moreover, it is impossible to disable an interrupt once it is armed, neither
-  // change the callback function.
-  // NOTE: don't know why, but the timer seem trigger even when it is not set...
-  // so a provvisory solution if to set the relative callback to NULL!
-  // NOTE 2: this improvement should be think even for multiple lamp!
-  if (thyristorManaged < Thyristor::nThyristors && pinDelay[thyristorManaged].delay < semiPeriodLength) {
-    uint16_t delayAbsolute = pinDelay[thyristorManaged].delay;
+  if (snapshot->nEvents > 0) {
+    setNextISR(activate_thyristors);
+    if (!armTimer(snapshot->events[0].ticks)) { serveEvents(); }
+#ifdef COMPARE_GATES_AVAILABLE
+  } else if (snapshot->compareOffChannels) {
+    // No gate is fired by the ISRs, but the ones fired by the timer must be turned off
+    setNextISR(turn_off_gates_int);
+    if (!armTimer(snapshot->events[0].ticks)) { turn_off_gates_int(); }
+#endif
+  } else {
+    endSchedule();
+  }
+}
+
+#ifdef ZC_PLL
+/**
+ * Lock the timebase on the current edge, which starts the semi-period.
+ */
+static inline __attribute__((always_inline)) void lockTimebase() {
+  // The nominal semi-period is unknown, the edges start the semi-periods until it is set
+  if (pllNominalPeriod == 0) { return; }
+
+  pllLocked = true;
+  pllPeriod = (uint32_t)pllNominalPeriod << pllFractionBits;
+  pllPhaseFraction = 0;
+  pllNextStart = pllNominalPeriod;
+  pllError = 0;
+  pllEdgeSeen = true;
+  pllEdgeNext = false;
+  pllMissed = 0;
+#ifdef ZC_SINGLE_EDGE
+  pllOddSemiPeriod = false;
+#endif
+#ifdef ZC_DECIMATION
+  pllDecimationCount = 0;
+  pllSampling = true;
+  pllSettling = pllSettleLength;
+#endif
+}
+
+/**
+ * Measure the phase error of the current edge w.r.t. the closest predicted zero crossing, i.e. the
+ * start of the current semi-period or of the next one. The edges out of the window, or not
+ * expected, or after the first accepted one are ignored.
+ */
+static inline __attribute__((always_inline)) void trackEdge() {
+  timer_ticks_t elapsed = edgeTicks();
+  bool next = elapsed > pllNextStart / 2;
+  int32_t error = next ? (int32_t)elapsed - pllNextStart : (int32_t)elapsed;
+  if (error > pllWindowTicks || error < -(int32_t)pllWindowTicks) { return; }
+
+#ifdef ZC_SINGLE_EDGE
+  // Only the even semi-periods start with an edge
+  if (next != pllOddSemiPeriod) { return; }
+#endif
+#ifdef ZC_DECIMATION
+  // Once settled, only the zero crossing starting the semi-period 0 is tracked
+  if (!pllSettling && next != (pllDecimationCount == ZC_DECIMATION - 1)) { return; }
+#endif
+
+  if (next) {
+    if (pllEdgeNext) { return; }
+    pllEdgeNext = true;
+  } else {
+    if (pllEdgeSeen) { return; }
+    pllEdgeSeen = true;
+  }
+  pllError = error;
+#ifdef ZC_DECIMATION
+  if (error > pllSettleErrorTicks || error < -(int32_t)pllSettleErrorTicks) {
+    pllSettling = pllSettleLength;
+  }
+#endif
+}
+
+/**
+ * Timer routine starting a semi-period at the predicted zero crossing, when the timebase is locked.
+ */
 #if defined(ARDUINO_ARCH_ESP8266)
-    timer1_attachInterrupt(activate_thyristors);
-    timer1_write(US_TO_RTC_TIMER_TICKS(delayAbsolute));
+void HW_TIMER_IRAM_ATTR semi_period_int() {
 #elif defined(ARDUINO_ARCH_ESP32)
-    // setCallback(activate_thyristors);
-    nextISR = INT_TYPE::ACTIVATE_THYRISTORS;
-    startTimerAndTrigger(delayAbsolute);
-#elif defined(ARDUINO_ARCH_AVR)
-    timerSetCallback(activate_thyristors);
-    timerSetAlarm(microsecond2Tick(delayAbsolute));
-#elif defined(ARDUINO_ARCH_SAMD)
-  timerSetCallback(activate_thyristors);
-  timerStart(microsecond2Tick(delayAbsolute));
-#elif defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)
-  timerSetCallback(activate_thyristors);
-  timerStart(pinDelay[thyristorManaged].delay);
+void ARDUINO_ISR_ATTR semi_period_int() {
 #else
-  # error "Not implemented"
+void semi_period_int() {
 #endif
-  } else {
-
-    // This while is dedicated to all those thyristor wih delay == semiPeriodLength-margin; those
-    // are the ones who shouldn't turn on, hence they can be skipped
-    while (thyristorManaged < Thyristor::nThyristors && pinDelay[thyristorManaged].delay == semiPeriodLength) {
-      thyristorManaged++;
+  // Latch the origin at the predicted zero crossing, i.e. when the timer was due, so the latency of
+  // this ISR doesn't delay the whole semi-period
+  timer_ticks_t elapsed = elapsedTicks();
+  startSchedule(elapsed > pllNextStart ? elapsed - pllNextStart : 0);
+
+  // The missing edges are synthesized up to pllMaxMissed, then the signal is considered lost and
+  // the next edge locks the timebase again
+#ifdef ZC_SINGLE_EDGE
+  bool expected = !pllOddSemiPeriod;
+  pllOddSemiPeriod = !pllOddSemiPeriod;
+#else
+  bool expected = true;
+#endif
+#ifdef ZC_DECIMATION
+  // The count goes on while settling, so the semi-period 0 stays even with ZC_SINGLE_EDGE
+  const bool settling = pllSettling != 0;
+  expected = expected && (settling || pllDecimationCount == 0);
+  pllDecimationCount = pllDecimationCount == ZC_DECIMATION - 1 ? 0 : pllDecimationCount + 1;
+  if (settling) { pllSettling--; }
+  pllSampling =
+    pllSettling || pllDecimationCount == 0 || pllDecimationCount == ZC_DECIMATION - 1;
+#endif
+  if (expected) {
+    if (pllEdgeSeen) {
+      pllMissed = 0;
+    } else if (++pllMissed > pllMaxMissed) {
+      pllLocked = false;
+      stopSchedule();
+      clearGates(snapshot->allGates);
+      TRACE_GATES(TRACE_GATES_LOW, snapshot->allPins);
+#ifdef COMPARE_GATES_AVAILABLE
+      timerCompareClear(snapshot->compareChannels);
+#endif
+      return;
     }
+  }
+  pllEdgeSeen = pllEdgeNext;
+  pllEdgeNext = false;
+
+  // Proportional-integral correction: the period absorbs the frequency error, the start of the
+  // next semi-period the phase error. The period is bounded to 1/16 from the nominal one. The error
+  // can be negative, so it is scaled by multiplication, a left shift would be undefined.
+#ifdef ZC_DECIMATION
+  int32_t period = pllPeriod
+                   + (settling ? pllError * (1 << (pllFractionBits - pllFrequencyShift))
+                               : pllError * (1 << (pllFractionBits - pllDecimatedFrequencyShift))
+                                   / ZC_DECIMATION);
+#else
+  int32_t period = pllPeriod + pllError * (1 << (pllFractionBits - pllFrequencyShift));
+#endif
+  const int32_t nominal = (int32_t)pllNominalPeriod << pllFractionBits;
+  if (period > nominal + nominal / 16) {
+    period = nominal + nominal / 16;
+  } else if (period < nominal - nominal / 16) {
+    period = nominal - nominal / 16;
+  }
+  pllPeriod = period;
+  const uint32_t length = period + pllPhaseFraction;
+  pllPhaseFraction = length & ((1 << pllFractionBits) - 1);
+  pllNextStart = (length >> pllFractionBits) + (pllError >> pllPhaseShift);
+  pllError = 0;
+
+  start_semi_period();
+}
+#endif
 
 #if defined(ARDUINO_ARCH_ESP8266)
-    // Given the Arduino HAL and esp8266 technical reference manual,
-    // when timer triggers, the counter stops because it has reached zero
-    // and no-autorealod was set (this timer can only down-count).
+void HW_TIMER_IRAM_ATTR zero_cross_int() {
 #elif defined(ARDUINO_ARCH_ESP32)
-    stopTimer();
-#elif defined(ARDUINO_ARCH_AVR)
-    timerStop();
-#elif defined(ARDUINO_ARCH_SAMD)
-  // Given actual HAL, and SAMD counter automatically stops on interrupt
-#elif defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)
-    // Timer callback is not rescheduled
+void ARDUINO_ISR_ATTR zero_cross_int() {
+#else
+void zero_cross_int() {
+#endif
+#ifdef ZC_DECIMATION
+  // Between the tracked zero crossings, the edges are not even timestamped
+  if (pllLocked && !pllSampling) { return; }
 #endif
+  PROFILE_ISR(zeroCross);
+  TRACE_EVENT(TRACE_ZERO_CROSS);
+
+#ifdef ISR_STATS
+  {
+    uint32_t now = micros();
+    lockIsrDataFromIsr();
+    uint32_t interval = now - lastZeroCross;
+    if (lastZeroCross && interval <= 0xFFFF) {
+      if (interval < stats.minZeroCrossInterval) { stats.minZeroCrossInterval = interval; }
+      if (interval > stats.maxZeroCrossInterval) { stats.maxZeroCrossInterval = interval; }
+    }
+    lastZeroCross = now;
+    unlockIsrDataFromIsr();
+  }
+#endif
+
+#if defined(FILTER_INT_PERIOD) || defined(MONITOR_FREQUENCY)
+  uint32_t now = micros();
+
+  // "diff" is correct even when timer rolls back, because these values are unsigned
+  uint32_t diff = now - lastTime;
+
+#if defined(ZC_CAPTURE_AVAILABLE) && !defined(ZC_PLL)
+  // The origin of the schedule is the previous edge, so the captured ticks measure the time from
+  // the previous edge without the interrupt latency (unless the counter has overflowed meanwhile)
+  if (zcCaptured && diff < semiPeriodLength + semiPeriodLength / 2) {
+    diff = timerCaptureRead() >> ticksPerMicroShift;
+  }
+#endif
+
+  if (lastTime) {
+#ifdef PRINT_INT_PERIOD
+    if (diff < semiPeriodLength - semiPeriodShrinkMargin) {
+#ifdef ARDUINO_ARCH_ESP32
+      ets_printf("B%d\n", diff);
+#else
+      Serial.println(String('B') + diff);
+#endif
+    }
+    if (diff > semiPeriodLength + semiPeriodExpandMargin) {
+#ifdef ARDUINO_ARCH_ESP32
+      ets_printf("A%d\n", diff);
+#else
+      Serial.println(String('A') + diff);
+#endif
+    }
+#endif
+
+#ifdef FILTER_INT_PERIOD
+    // Filters out spurious interrupts. The effectiveness of this simple
+    // filter could vary depending on noise on electrical networ.
+    if (diff < semiPeriodLength - semiPeriodShrinkMargin) { return; }
+#endif
+  }
+#endif
+
+#ifdef ZC_PLL
+  if (pllLocked) {
+    trackEdge();
+  } else {
+    startSchedule(edgeAge());
+  }
+#else
+  // Latch the origin of the schedule as soon as possible, since the instructions executed in this
+  // ISR may take much time (e.g. more than 30us on AVR). Before the end of this ISR, either the
+  // timer is stopped or the alarm is properly set.
+  startSchedule(edgeAge());
+#endif
+
+#if defined(FILTER_INT_PERIOD) || defined(MONITOR_FREQUENCY)
+#ifdef MONITOR_FREQUENCY
+  if (lastTime) {
+    // if diff is very very greater than the theoretical value, the electrical signal
+    // can be considered as lost for a while and I must reset my moving average.
+    // I decided to use "16" because is a power of 2, very fast to be computed.
+    if (semiPeriodLength && diff > semiPeriodLength * 16) {
+      resetFrequencyMonitor();
+    } else {
+      // If filtering has passed, I can update the estimation
+      addFrequencySample(diff);
+    }
   }
+#endif
+
+  lastTime = now;
+#endif
+
+#ifdef ZC_PLL
+  // When locked, the semi-periods are started by the timer
+  if (pllLocked) { return; }
+  lockTimebase();
+#endif
+
+  start_semi_period();
 }
 
 #if defined(ARDUINO_ARCH_ESP8266)
@@ -497,11 +1776,7 @@ void ARDUINO_ISR_ATTR isr_selector() {
 #else
 void isr_selector() {
 #endif
-  if (nextISR == INT_TYPE::ACTIVATE_THYRISTORS) {
-    activate_thyristors();
-  } else if (nextISR == INT_TYPE::TURN_OFF_GATES) {
-    turn_off_gates_int();
-  }
+  if (nextISR != nullptr) { nextISR(); }
 }
 
 void Thyristor::setDelay(uint16_t newDelay) {
@@ -516,11 +1791,23 @@ void Thyristor::setDelay(uint16_t newDelay) {
 
   if (newDelay > semiPeriodLength) { newDelay = semiPeriodLength; }
 
+#ifdef BURST_FIRE
+  if (burstWindow != 0) {
+    // Back to phase control, from the delay of always off (see setBurstFire(..))
+    burstWindow = 0;
+    burstPatternChanged = true;
+    if (newDelay == semiPeriodLength) {
+      allThyristorsOnOff = areThyristorsOnOff();
+      publishSnapshot();
+      return;
+    }
+  }
+#endif
+
   // Reorder the array to speed up the interrupt.
   // This mini-algorithm works on a different memory area w.r.t. the ISR,
   // so it is concurrent-safe
 
-  updatingStruct = true;
   // Array example, it is always ordered, higher values means lower brightness levels
   // [45,678,5000,7500,9000]
   if (newDelay > delay) {
@@ -591,19 +1878,14 @@ void Thyristor::setDelay(uint16_t newDelay) {
   } else {
     if (verbosity > 2)
       Serial.println("Warning: you are setting the same delay as the previous one!");
-    updatingStruct = false;
     return;
   }
 
   delay = newDelay;
   bool enableInt = mustInterruptBeReEnabled(newDelay);
-  newDelayValues = true;
-  updatingStruct = false;
-  if (enableInt) {
-    if (verbosity > 2) Serial.println("Re-enabling interrupt");
-    interruptEnabled = true;
-    attachInterrupt(digitalPinToInterrupt(syncPin), zero_cross_int, syncDir);
-  }
+  publishSnapshot();
+  // The ISR may have disabled the interrupt meanwhile, with the previous snapshot
+  if (enableInt || !interruptEnabled) { enableInterrupt(); }
 
   if (verbosity > 2) {
     for (int i = 0; i < Thyristor::nThyristors; i++) {
@@ -615,10 +1897,159 @@ void Thyristor::setDelay(uint16_t newDelay) {
   }
 }
 
+void Thyristor::setDelays(Thyristor *const targets[], const uint16_t delays[],
+                          thyristor_count_t n) {
+  for (thyristor_count_t i = 0; i < n; i++) {
+    targets[i]->delay = delays[i] > semiPeriodLength ? semiPeriodLength : delays[i];
+#ifdef BURST_FIRE
+    if (targets[i]->burstWindow) {
+      targets[i]->burstWindow = 0;
+      burstPatternChanged = true;
+    }
+#endif
+  }
+
+  sortThyristors();
+  allThyristorsOnOff = areThyristorsOnOff();
+  if (verbosity > 1) Serial.println(String("allThyristorsOnOff: ") + allThyristorsOnOff);
+  publishSnapshot();
+  if (!interruptEnabled) { enableInterrupt(); }
+}
+
+void Thyristor::attachZeroCross() {
+#ifdef PIO_ENGINE_AVAILABLE
+  pioEngineRunning = pioEngineStart(syncPin, syncDir == RISING);
+  if (pioEngineRunning) { return; }
+  if (verbosity > 0) Serial.println("PIO engine not available, using interrupt");
+#endif
+#ifdef ZC_CAPTURE_AVAILABLE
+  zcCaptured = timerCaptureBegin(syncPin, syncDir, zero_cross_int);
+  if (zcCaptured) { return; }
+  if (verbosity > 0) Serial.println("Input capture not available on sync pin, using interrupt");
+#endif
+#ifdef CORE1_ENGINE_AVAILABLE
+  if (core1Ready && get_core_num() != 1) {
+    attachRequested = true;
+    __sev();
+    return;
+  }
+#endif
+  attachInterrupt(digitalPinToInterrupt(syncPin), zero_cross_int, syncDir);
+}
+
+void Thyristor::detachZeroCross() {
+#ifdef PIO_ENGINE_AVAILABLE
+  if (pioEngineRunning) {
+    pioEngineStop();
+    pioEngineRunning = false;
+    return;
+  }
+#endif
+#ifdef ZC_CAPTURE_AVAILABLE
+  if (zcCaptured) {
+    timerCaptureEnd();
+    return;
+  }
+#endif
+  detachInterrupt(digitalPinToInterrupt(syncPin));
+}
+
+void Thyristor::enableInterrupt() {
+  if (verbosity > 2) Serial.println("Re-enabling interrupt");
+  interruptEnabled = true;
+  attachZeroCross();
+}
+
+bool Thyristor::disableInterrupt() {
+  // The thread context re-enables the interrupt if it finds it disabled after publishing a
+  // snapshot, so either this or that sees the other, even from different cores.
+  interruptEnabled = false;
+  memoryBarrier();
+  if (!(publishedSnapshot & SNAPSHOT_FRESH)) {
+    detachZeroCross();
+    memoryBarrier();
+    if (!(publishedSnapshot & SNAPSHOT_FRESH)) { return true; }
+    // Published while detaching, the attach of the other core may have been undone
+    attachZeroCross();
+  }
+  interruptEnabled = true;
+  return false;
+}
+
+void Thyristor::sortThyristors() {
+  // Insertion sort, the array is usually almost sorted
+  for (int i = 1; i < nThyristors; i++) {
+    Thyristor *t = thyristors[i];
+    int j = i - 1;
+    while (j >= 0 && thyristors[j]->delay > t->delay) {
+      thyristors[j + 1] = thyristors[j];
+      j--;
+    }
+    thyristors[j + 1] = t;
+  }
+  for (int i = 0; i < nThyristors; i++) { thyristors[i]->posIntoArray = i; }
+}
+
 void Thyristor::turnOn() {
   setDelay(semiPeriodLength);
 }
 
+#ifdef ARDUINO_ARCH_ESP32
+/**
+ * Run the function on the interrupt core and wait for its completion.
+ */
+static void runOnInterruptCore(void (*function)()) {
+#if portNUM_PROCESSORS > 1
+  if (interruptCore >= 0 && interruptCore != xPortGetCoreID()) {
+    struct Job {
+      void (*function)();
+      TaskHandle_t caller;
+    } job = { function, xTaskGetCurrentTaskHandle() };
+    auto run = [](void *arg) {
+      Job *job = (Job *)arg;
+      job->function();
+      xTaskNotifyGive(job->caller);
+      vTaskDelete(nullptr);
+    };
+    xTaskCreatePinnedToCore(run, "dimmer", 2048, &job, configMAX_PRIORITIES - 1, nullptr,
+                            interruptCore);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    return;
+  }
+#endif
+  function();
+}
+
+void Thyristor::setInterruptCore(uint8_t core) {
+  interruptCore = core;
+}
+#endif
+
+#ifdef CORE1_ENGINE_AVAILABLE
+/**
+ * Entry point of core 1: allocate the timer interrupt, then attach the zero-cross one on request of
+ * core 0. The ISRs preempt this loop.
+ */
+void core1_main() {
+#ifdef ISR_STATS
+  beginSysTick();
+#endif
+  timerSetCallback(activate_thyristors);
+  timerBegin();
+  core1Ready = true;
+
+  while (true) {
+    __wfe();
+    if (!attachRequested) { continue; }
+    noInterrupts();
+    attachRequested = false;
+    // Meanwhile the ISR may have disabled it again
+    if (interruptEnabled) { Thyristor::attachZeroCross(); }
+    interrupts();
+  }
+}
+#endif
+
 void Thyristor::begin() {
   pinMode(syncPin, syncPullup ? INPUT_PULLUP : INPUT);
 
@@ -628,20 +2059,80 @@ void Thyristor::begin() {
   // timer1_enable(TIM_DIV16, TIM_EDGE, TIM_SINGLE);
   T1C = (1 << TCTE) | ((TIM_DIV16 & 3) << TCPD) | ((TIM_EDGE & 1) << TCIT) | ((TIM_SINGLE & 1) << TCAR);
   T1I = 0;
+  cyclesPerTickShift = ESP.getCpuFreqMHz() > 80 ? 5 : 4;
 #elif defined(ARDUINO_ARCH_ESP32)
-  timerInit(isr_selector);
-#elif defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_SAMD) || (defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED))
+  // Interrupts are served by the core that allocates them: the timer one here, the GPIO one by the
+  // first attachInterrupt(..) of the sketch, then the following ones just add their handlers
+  runOnInterruptCore([]() {
+    timerInit(isr_selector);
+    attachInterrupt(digitalPinToInterrupt(syncPin), []() {}, syncDir);
+    detachInterrupt(digitalPinToInterrupt(syncPin));
+  });
+#elif defined(CORE1_ENGINE_AVAILABLE)
+  if (!core1Ready) {
+    snapshotLock = spin_lock_instance(spin_lock_claim_unused(true));
+    multicore_launch_core1(core1_main);
+    while (!core1Ready) {}
+  }
+#elif defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_SAMD) || (defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED)) || defined(ARDUINO_ARCH_NATIVE)
   timerSetCallback(activate_thyristors);
   timerBegin();
 #else
   #error "Not implemented"
 #endif
 
+  maxLatencyTicks = microsecond2TimerTicks(maxLatencySample);
+#ifdef ZC_CAPTURE_AVAILABLE
+  while ((1000 << (ticksPerMicroShift + 1)) <= microsecond2TimerTicks(1000)) { ticksPerMicroShift++; }
+#endif
+#ifdef ZC_PLL
+  pllWindowTicks = microsecond2TimerTicks(pllWindow);
+#ifdef ZC_DECIMATION
+  pllSettleErrorTicks = microsecond2TimerTicks(pllSettleError);
+#endif
+#endif
+
+#ifdef ADAPTIVE_MERGE_PERIOD
+  // Time a few events, unless the thyristors are already being fired
+  if (!interruptEnabled) {
+    probeCount = 0;
+    probeCost = 0;
+    probeTicks = microsecond2TimerTicks(mergeProbeInterval);
+    setNextISR(merge_probe_int);
+    startSchedule(0);
+    if (armTimer(probeTicks)) {
+      for (uint8_t i = 0; i < 10 && probeCount < mergeProbes; i++) { ::delay(1); }
+    }
+    stopSchedule();
+    setNextISR(activate_thyristors);
+
+    // The worst probe seeds the filter
+    noInterrupts();
+    filteredEventCost = probeCost << latencyFilterShift;
+    interrupts();
+    updateMergePeriod();
+    publishSnapshot();
+  }
+#endif
+
+#ifdef ISR_STATS
+#if defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED) && !defined(CORE1_ENGINE_AVAILABLE)
+  beginSysTick();
+#endif
+  resetStats();
+#endif
+
+#ifdef MCPWM_GATES_AVAILABLE
+  // From now on, the gates can be moved to the MCPWM generators
+  mcpwmGatesBegin(syncPin, syncDir == RISING);
+  publishSnapshot();
+#endif
+
 #ifdef MONITOR_FREQUENCY
   // Starts immediately to sense the eletricity grid
 
   interruptEnabled = true;
-  attachInterrupt(digitalPinToInterrupt(syncPin), zero_cross_int, syncDir);
+  attachZeroCross();
 #endif
 }
 
@@ -650,6 +2141,82 @@ float Thyristor::getFrequency() {
   return 1000000 / 2 / (float)(semiPeriodLength);
 }
 
+void Thyristor::setZeroCrossOffset(int16_t offset) {
+  if (offset > maxZeroCrossOffset) {
+    offset = maxZeroCrossOffset;
+  } else if (offset < -maxZeroCrossOffset) {
+    offset = -maxZeroCrossOffset;
+  }
+  zeroCrossOffset = offset;
+  publishSnapshot();
+}
+
+int16_t Thyristor::getZeroCrossOffset() {
+  return zeroCrossOffset;
+}
+
+#ifdef ISR_STATS
+Thyristor::Stats Thyristor::getStats() {
+  lockIsrData();
+  Stats copy = stats;
+  unlockIsrData();
+  return copy;
+}
+
+void Thyristor::resetStats() {
+  lockIsrData();
+  memset(&stats, 0, sizeof(stats));
+  stats.zeroCross.minCycles = UINT32_MAX;
+  stats.activate.minCycles = UINT32_MAX;
+  stats.turnOff.minCycles = UINT32_MAX;
+  stats.minZeroCrossInterval = UINT16_MAX;
+  lastZeroCross = 0;
+  unlockIsrData();
+}
+#endif
+
+uint16_t Thyristor::getIsrLatency() {
+  lockIsrData();
+  uint32_t latency = filteredLatency >> latencyFilterShift;
+  unlockIsrData();
+  return latency * 1000 / microsecond2TimerTicks(1000);
+}
+
+void Thyristor::calibrate() {
+#ifdef ADAPTIVE_MERGE_PERIOD
+  updateMergePeriod();
+#endif
+  publishSnapshot();
+}
+
+#ifdef BURST_FIRE
+void Thyristor::setBurstFire(uint16_t onSemiPeriods, uint16_t window) {
+  if (window == 0) { return; }
+  if (onSemiPeriods > window) { onSemiPeriods = window; }
+
+  // Out of the phase control, as if always off
+  if (burstWindow == 0) { setDelay(semiPeriodLength); }
+  burstOn = onSemiPeriods;
+  burstWindow = window;
+  burstPatternChanged = true;
+  allThyristorsOnOff = areThyristorsOnOff();
+  publishSnapshot();
+  if (!interruptEnabled) { enableInterrupt(); }
+}
+#endif
+
+#ifdef PREDEFINED_PULSE_LENGTH
+void Thyristor::setPulseWidth(uint16_t width) {
+  if (width == pulseWidth) { return; }
+  pulseWidth = width;
+  publishSnapshot();
+}
+#endif
+
+uint16_t Thyristor::getMergePeriod() {
+  return mergePeriod;
+}
+
 uint16_t Thyristor::getSemiPeriod() {
   return semiPeriodLength;
 }
@@ -660,17 +2227,40 @@ void Thyristor::setFrequency(float frequency) {
 
   if (frequency == 0) {
     semiPeriodLength = 0;
+    publishSnapshot();
     return;
   }
 
   semiPeriodLength = 1000000 / 2 / frequency;
+  // Margins depend on the semi-period length
+  publishSnapshot();
 }
 #endif
 
 #ifdef MONITOR_FREQUENCY
-float Thyristor::getDetectedFrequency() {
+/**
+ * Convert a semi-period, expressed in 1/16 of microsecond, to the frequency in millihertz. It is a
+ * 2-step long division to keep the precision with 32-bit integers.
+ */
+static uint32_t semiPeriodToMilliHz(uint32_t semiPeriod) {
+  // *1000000000: from us to mHz
+  // /2: from semiperiod to full period
+  // *16: from 1/16 of us to us
+  static const uint32_t dividend = 1000000000 / 2;
+  uint32_t quotient = dividend / semiPeriod;
+  uint32_t remainder = dividend % semiPeriod;
+  return quotient * 16 + remainder * 16 / semiPeriod;
+}
+
+uint32_t Thyristor::getDetectedFrequencyMilliHz() {
   int c;
+#ifdef MONITOR_FREQUENCY_IIR
+  uint32_t filtered;
+#elif defined(MONITOR_FREQUENCY_TRIMMED_MEAN)
+  uint16_t samples[MONITOR_FREQUENCY_WINDOW];
+#else
   uint32_t tot;
+#endif
   {
     // Stop interrupt to freeze variables modified or accessed in the interrupt
     noInterrupts();
@@ -681,24 +2271,54 @@ float Thyristor::getDetectedFrequency() {
     // if diff is very very greater than the theoretical value, the electrical signal
     // can be considered as lost for a while.
     // I decided to use "16" because is a power of 2, very fast to be computed.
-    if (semiPeriodLength && diff > semiPeriodLength * 16) {
-      queue.reset();
-      total = 0;
-    }
+    if (semiPeriodLength && diff > semiPeriodLength * 16) { resetFrequencyMonitor(); }
 
+#ifdef MONITOR_FREQUENCY_IIR
+    c = nSamples;
+    filtered = filteredSemiPeriod;
+#elif defined(MONITOR_FREQUENCY_TRIMMED_MEAN)
+    c = queue.getCount();
+    for (int i = 0; i < c; i++) { samples[i] = queue.get(i); }
+#else
     c = queue.getCount();
     tot = total;
+#endif
     interrupts();
   }
 
   // We need at least a sample to return a value differnt from 0
-  if (tot > 0) {
-    // *1000000: us
-    // /2: from semiperiod to full period
-    float result = c * 1000000 / 2 / ((float)(tot));
-    return result;
+  if (c == 0) { return 0; }
+
+  // Semi-period in 1/16 of microsecond
+  uint32_t semiPeriod;
+#ifdef MONITOR_FREQUENCY_IIR
+  semiPeriod = filtered * 16 / MONITOR_FREQUENCY_WINDOW;
+#elif defined(MONITOR_FREQUENCY_TRIMMED_MEAN)
+  // Insertion sort, then average the central half
+  for (int i = 1; i < c; i++) {
+    uint16_t v = samples[i];
+    int j = i - 1;
+    while (j >= 0 && samples[j] > v) {
+      samples[j + 1] = samples[j];
+      j--;
+    }
+    samples[j + 1] = v;
   }
-  return 0;
+  int first = c / 4;
+  int last = c - c / 4;
+  uint32_t tot = 0;
+  for (int i = first; i < last; i++) { tot += samples[i]; }
+  semiPeriod = tot * 16 / (last - first);
+#else
+  semiPeriod = tot * 16 / c;
+#endif
+
+  if (semiPeriod == 0) { return 0; }
+  return semiPeriodToMilliHz(semiPeriod);
+}
+
+float Thyristor::getDetectedFrequency() {
+  return getDetectedFrequencyMilliHz() / 1000.0f;
 }
 
 void Thyristor::frequencyMonitorAlwaysOn(bool enable) {
@@ -708,7 +2328,7 @@ void Thyristor::frequencyMonitorAlwaysOn(bool enable) {
 
     if (enable && !interruptEnabled) {
       interruptEnabled = true;
-      attachInterrupt(digitalPinToInterrupt(syncPin), zero_cross_int, syncDir);
+      attachZeroCross();
     }
     frequencyMonitorAlwaysEnabled = enable;
 
@@ -717,42 +2337,41 @@ void Thyristor::frequencyMonitorAlwaysOn(bool enable) {
 }
 #endif
 
-Thyristor::Thyristor(int pin) : pin(pin), delay(semiPeriodLength) {
+Thyristor::Thyristor(int pin)
+  : pin(pin), gatePort(gpioPort(pin)), gateMask(gpioMask(pin)), delay(semiPeriodLength) {
+#ifdef PREDEFINED_PULSE_LENGTH
+  pulseWidth = defaultPulseWidth;
+#endif
+#ifdef BURST_FIRE
+  burstOn = 0;
+  burstWindow = 0;
+#endif
   if (nThyristors < N) {
     pinMode(pin, OUTPUT);
-
-    updatingStruct = true;
+    // From now on, the gate is driven through its port. On AVR, digitalWrite(..) also disconnects
+    // the pin from PWM.
+    digitalWrite(pin, LOW);
 
     posIntoArray = nThyristors;
     nThyristors++;
     thyristors[posIntoArray] = this;
 
-    // Full reorder of the array
-    for (int i = 0; i < nThyristors; i++) {
-      for (int j = i + 1; j < nThyristors - 1; j++) {
-        if (thyristors[i]->delay > thyristors[j]->delay) {
-          Thyristor* temp = thyristors[i];
-          thyristors[i] = thyristors[j];
-          thyristors[j] = temp;
-        }
-      }
-    }
-    // Set the posIntoArray with a "brutal" assignement to each Thyristor
-    for (int i = 0; i < nThyristors; i++) { thyristors[i]->posIntoArray = i; }
+    sortThyristors();
 
-    newDelayValues = true;
-    updatingStruct = false;
+    publishSnapshot();
   } else {
     // TODO return error or exception
   }
 }
 
 Thyristor::~Thyristor() {
+#ifdef BURST_FIRE
+  if (burstWindow) { burstPatternChanged = true; }
+#endif
   // Recompact the array
-  updatingStruct = true;
   nThyristors--;
-  // TODO remove light from the static pinDelay array, and shrink the array
-  updatingStruct = false;
+  // TODO remove light from the static thyristors array, and shrink the array
+  publishSnapshot();
 }
 
 bool Thyristor::areThyristorsOnOff() {
@@ -761,6 +2380,11 @@ bool Thyristor::areThyristorsOnOff() {
   while (i < nThyristors && allOnOff) {
     if (thyristors[i]->getDelay() != 0 && thyristors[i]->getDelay() != semiPeriodLength) {
       allOnOff = false;
+#ifdef BURST_FIRE
+    } else if (thyristors[i]->burstWindow && thyristors[i]->burstOn) {
+      // Switched by the zero-cross interrupt
+      allOnOff = false;
+#endif
     } else {
       i++;
     }
@@ -786,10 +2410,461 @@ bool Thyristor::mustInterruptBeReEnabled(uint16_t newDelay) {
   return !interruptEnabled && interruptMustBeEnabled;
 }
 
-uint8_t Thyristor::nThyristors = 0;
+#ifdef GATE_TRACE
+uint64_t Thyristor::tracePins(int from, int to) {
+  uint64_t pins = 0;
+  for (int i = from; i < to; i++) {
+#ifdef COMPARE_GATES_AVAILABLE
+    // The gates fired by the timer are not traced
+    if (timerComparePin(thyristors[i]->pin)) { continue; }
+#endif
+#ifdef MCPWM_GATES_AVAILABLE
+    if (mcpwmGatesAttach(thyristors[i]->pin) >= 0) { continue; }
+#endif
+    if (thyristors[i]->pin < 64) { pins |= (uint64_t)1 << thyristors[i]->pin; }
+  }
+  return pins;
+}
+
+void Thyristor::setTraceEnabled(bool enable) {
+  traceEnabled = enable;
+}
+
+bool Thyristor::isTraceEnabled() {
+  return traceEnabled;
+}
+
+uint16_t Thyristor::readTrace(TraceRecord records[], uint16_t max) {
+  trace_index_t tail = traceTail;
+  trace_index_t head = traceHead;
+  uint16_t n = 0;
+  while (n < max && tail != head) {
+    records[n] = traceBuffer[tail & (GATE_TRACE_SIZE - 1)];
+    tail++;
+    n++;
+  }
+
+  // The records must be copied before the ISRs can overwrite them
+  __asm__ __volatile__("" ::: "memory");
+  traceTail = tail;
+  return n;
+}
+
+void Thyristor::drainTrace(Print &out) {
+  TraceRecord records[8];
+  uint16_t n;
+  while ((n = readTrace(records, 8)) > 0) {
+    for (uint16_t i = 0; i < n; i++) {
+      char hex[17];
+      uint8_t digit = sizeof(hex) - 1;
+      uint64_t value = records[i].pins;
+      hex[digit] = '\0';
+      do {
+        hex[--digit] = "0123456789abcdef"[value & 0xF];
+        value >>= 4;
+      } while (value);
+
+      out.print((unsigned long)records[i].time);
+      out.print(' ');
+      out.print((char)records[i].type);
+      out.print(' ');
+      out.print(&hex[digit]);
+      out.println();
+    }
+  }
+}
+#endif
+
+#ifdef BURST_FIRE
+static uint16_t greatestCommonDivisor(uint16_t a, uint16_t b) {
+  while (b) {
+    uint16_t r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+/**
+ * Precompute the burst-fire pattern of n thyristors, with the given gates and duties (on
+ * semi-periods out of the window). It is a sigma-delta modulation shared by the thyristors: each
+ * one accumulates the error w.r.t. its duty, and the conducting semi-periods of the thyristors are
+ * staggered to keep their total current as flat as possible. Each thyristor conducts exactly its
+ * duty in every period of the pattern.
+ */
+static void buildBurstPattern(struct Snapshot &s, thyristor_count_t n, const gpio_port_t ports[],
+                              const gpio_mask_t masks[], const uint16_t on[],
+                              const uint16_t windows[]) {
+  thyristor_count_t portOf[Thyristor::N];
+  s.nBurstPorts = 0;
+  for (thyristor_count_t i = 0; i < n; i++) {
+    thyristor_count_t j = 0;
+    while (j < s.nBurstPorts && s.burstPorts[j] != ports[i]) { j++; }
+    if (j == s.nBurstPorts) { s.burstPorts[s.nBurstPorts++] = ports[i]; }
+    portOf[i] = j;
+  }
+  s.burstLength = 0;
+  if (n == 0) { return; }
+
+  // The pattern repeats every least common multiple of the windows if it fits, so the duties are
+  // exact. Otherwise, they are rounded to the longest pattern fitting.
+  const uint16_t maxLength = BURST_PATTERN_SIZE / s.nBurstPorts;
+  uint32_t length = 1;
+  for (thyristor_count_t i = 0; i < n && length <= maxLength; i++) {
+    length = length / greatestCommonDivisor(length, windows[i]) * windows[i];
+  }
+  if (length > maxLength) { length = maxLength; }
+  s.burstLength = length;
+  memset(s.burstMasks, 0, length * s.nBurstPorts * sizeof(gpio_mask_t));
+
+  uint16_t counts[Thyristor::N];
+  uint16_t left[Thyristor::N];
+  int32_t errors[Thyristor::N];
+  uint32_t total = 0;
+  for (thyristor_count_t i = 0; i < n; i++) {
+    counts[i] = ((uint32_t)on[i] * length + windows[i] / 2) / windows[i];
+    left[i] = counts[i];
+    errors[i] = 0;
+    total += counts[i];
+  }
+
+  // The number of thyristors conducting in each semi-period is the total of the duties spread
+  // evenly, so it differs by 1 at most among the semi-periods. A thyristor with as many
+  // semi-periods left to conduct as the ones left in the pattern conducts first (e.g. at full
+  // duty): as long as none has more, the rest of the pattern can still give each one its count.
+  // The others conducting are the most behind their own duty, i.e. with the highest error.
+  for (uint16_t k = 0; k < length; k++) {
+    bool conducting[Thyristor::N];
+    for (thyristor_count_t i = 0; i < n; i++) {
+      errors[i] += counts[i];
+      conducting[i] = false;
+    }
+    uint32_t m = (k + 1) * total / length - k * total / length;
+    while (m--) {
+      thyristor_count_t best = n;
+      for (thyristor_count_t i = 0; i < n; i++) {
+        if (conducting[i] || left[i] == 0) { continue; }
+        if (left[i] == length - k) {
+          best = i;
+          break;
+        }
+        if (best == n || errors[i] > errors[best]) { best = i; }
+      }
+      conducting[best] = true;
+      left[best]--;
+      errors[best] -= length;
+      s.burstMasks[k * s.nBurstPorts + portOf[best]] |= masks[best];
+    }
+  }
+}
+
+/**
+ * Copy the burst-fire pattern of a snapshot into another one. The last published snapshot can be
+ * the one being written, then it already has the pattern.
+ */
+static void copyBurstPattern(struct Snapshot &to, const struct Snapshot &from) {
+  if (&to == &from) { return; }
+  to.burstLength = from.burstLength;
+  to.nBurstPorts = from.nBurstPorts;
+  memcpy(to.burstPorts, from.burstPorts, sizeof(to.burstPorts));
+  memcpy(to.burstMasks, from.burstMasks, from.burstLength * from.nBurstPorts * sizeof(gpio_mask_t));
+#ifdef GATE_TRACE
+  to.nBurstGates = from.nBurstGates;
+  memcpy(to.burstGates, from.burstGates, sizeof(to.burstGates));
+#endif
+}
+#endif
+
+void Thyristor::publishSnapshot() {
+  struct Snapshot &next = snapshots[threadSnapshot];
+
+  uint16_t delays[N];
+  gpio_port_t ports[N] = {};
+  gpio_mask_t masks[N] = {};
+#ifdef COMPARE_GATES_AVAILABLE
+  uint8_t channels[N];
+#endif
+#ifdef MCPWM_GATES_AVAILABLE
+  int8_t mcpwmGates[N];
+#endif
+  int alwaysOnCounter = 0;
+  for (int i = 0; i < nThyristors; i++) {
+    ports[i] = thyristors[i]->gatePort;
+    masks[i] = thyristors[i]->gateMask;
+#ifdef COMPARE_GATES_AVAILABLE
+    // The gates on the output compare channels are not written by the ISRs
+    channels[i] = timerComparePin(thyristors[i]->pin);
+    if (channels[i]) { masks[i] = 0; }
+#endif
+#ifdef MCPWM_GATES_AVAILABLE
+    // The same for the gates on the MCPWM generators
+    mcpwmGates[i] = mcpwmGatesAttach(thyristors[i]->pin);
+    if (mcpwmGates[i] >= 0) { masks[i] = 0; }
+#endif
+    // Rounding delays to avoid error and unexpected behavior due to
+    // non-ideal thyristors and not perfect sine wave
+    if (thyristors[i]->delay < startMargin) {
+      alwaysOnCounter++;
+      delays[i] = 0;
+    } else if (thyristors[i]->delay > semiPeriodLength - endMargin) {
+      delays[i] = semiPeriodLength;
+    } else {
+      delays[i] = thyristors[i]->delay;
+    }
+  }
+  next.allThyristorsOnOff = allThyristorsOnOff;
+#ifdef MCPWM_GATES_AVAILABLE
+  // The zero-cross interrupt can be disabled also if only the MCPWM gates are not on or off
+  next.allThyristorsOnOff = true;
+  for (int i = 0; i < nThyristors; i++) {
+    if (mcpwmGates[i] < 0 && thyristors[i]->delay != 0
+        && thyristors[i]->delay != semiPeriodLength) {
+      next.allThyristorsOnOff = false;
+    }
+  }
+#endif
+
+  thyristor_count_t nWrites = 0;
+  next.allGates = appendGates(next, nWrites, ports, masks, 0, nThyristors);
+  next.alwaysOnGates = appendGates(next, nWrites, ports, masks, 0, alwaysOnCounter);
+#ifdef GATE_TRACE
+  next.allPins = tracePins(0, nThyristors);
+  next.alwaysOnPins = tracePins(0, alwaysOnCounter);
+#endif
+
+#ifdef BURST_FIRE
+  // The gates in burst-fire mode are lowered with all the others, then only raised by the
+  // zero-cross interrupt. They are always off for the phase control.
+  if (burstPatternChanged) {
+    thyristor_count_t n = 0;
+    gpio_port_t burstPorts[N];
+    gpio_mask_t burstMasks[N];
+    uint16_t on[N];
+    uint16_t windows[N];
+    for (int i = 0; i < nThyristors; i++) {
+      if (!thyristors[i]->burstWindow || !thyristors[i]->burstOn) { continue; }
+      burstPorts[n] = ports[i];
+      burstMasks[n] = masks[i];
+      on[n] = thyristors[i]->burstOn;
+      windows[n] = thyristors[i]->burstWindow;
+      n++;
+    }
+    buildBurstPattern(next, n, burstPorts, burstMasks, on, windows);
+#ifdef GATE_TRACE
+    next.nBurstGates = 0;
+    for (int i = 0; i < nThyristors; i++) {
+      if (!thyristors[i]->burstWindow || !thyristors[i]->burstOn) { continue; }
+      struct BurstGate &gate = next.burstGates[next.nBurstGates++];
+      gate.port = 0;
+      while (next.burstPorts[gate.port] != ports[i]) { gate.port++; }
+      gate.mask = masks[i];
+      gate.pins = tracePins(i, i + 1);
+    }
+#endif
+    burstPatternChanged = false;
+  } else {
+    copyBurstPattern(next, snapshots[lastPublishedSnapshot]);
+  }
+  for (int i = 0; i < nThyristors; i++) {
+    if (thyristors[i]->burstWindow) { masks[i] = 0; }
+  }
+#endif
+
+  // The schedule starts from the zero-cross interrupt: compensate the detector offset and the ISR
+  // latency
+  lockIsrData();
+  timer_ticks_t latency = filteredLatency >> latencyFilterShift;
+  unlockIsrData();
+
+#ifdef COMPARE_GATES_AVAILABLE
+  // The timer fires the gates on the output compare channels exactly, so the latency is not
+  // compensated. The thyristors always on are fired at the zero cross, the ones always off never.
+  next.compareChannels = 0;
+  next.compareOffChannels = 0;
+  next.nCompareFirings = 0;
+  for (int i = 0; i < nThyristors; i++) {
+    if (!channels[i]) { continue; }
+    next.compareChannels |= channels[i];
+    if (delays[i] >= semiPeriodLength) { continue; }
+
+    struct CompareFiring &firing = next.compareFirings[next.nCompareFirings++];
+    firing.channel = channels[i];
+    if (i < alwaysOnCounter) {
+      firing.ticks = 0;
+    } else {
+      firing.ticks =
+        compensatedTicks(delays[i], semiPeriodLength - gateTurnOffTime - mergePeriod, 0);
+      next.compareOffChannels |= channels[i];
+    }
+  }
+#endif
+
+#ifdef MCPWM_GATES_AVAILABLE
+  // The MCPWM timers start from the edges, so the latency is not compensated
+  if (semiPeriodLength > 0) {
+    const uint16_t gateOff = semiPeriodLength - gateTurnOffTime;
+    mcpwmGatesSetTiming(semiPeriodLength, gateOff);
+    for (int i = 0; i < nThyristors; i++) {
+      if (mcpwmGates[i] < 0) { continue; }
+      if (i < alwaysOnCounter) {
+        mcpwmGatesFire(mcpwmGates[i], MCPWM_GATE_ALWAYS_ON);
+      } else if (delays[i] >= semiPeriodLength) {
+        mcpwmGatesFire(mcpwmGates[i], MCPWM_GATE_ALWAYS_OFF);
+      } else {
+        mcpwmGatesFire(mcpwmGates[i], compensatedTicks(delays[i], gateOff, 0));
+      }
+    }
+  }
+#endif
+
+  // Group the near delays (see mergePeriod), skipping the thyristors always on and always off
+  next.nEvents = 0;
+#ifdef PREDEFINED_PULSE_LENGTH
+  // Delay of the event firing each thyristor
+  uint16_t firingDelays[N];
+#endif
+  int i = alwaysOnCounter;
+  while (i < nThyristors && delays[i] < semiPeriodLength) {
+#if defined(COMPARE_GATES_AVAILABLE) || defined(MCPWM_GATES_AVAILABLE)
+    // A group never starts from a gate fired by a peripheral, so it doesn't cost an interrupt
+    if (masks[i] == 0) {
+      i++;
+      continue;
+    }
+#endif
+    struct FiringEvent &event = next.events[next.nEvents];
+    const uint16_t firstDelay = delays[i];
+    const int first = i;
+    for (i++; i < nThyristors && delays[i] - firstDelay < mergePeriod; i++)
+      ;
+    event.gates = appendGates(next, nWrites, ports, masks, first, i);
+#ifdef GATE_TRACE
+    event.pins = tracePins(first, i);
+#endif
+
+    event.ticks =
+      compensatedTicks(firstDelay, semiPeriodLength - gateTurnOffTime - mergePeriod, latency);
+#ifdef PREDEFINED_PULSE_LENGTH
+    event.off = false;
+    for (int j = first; j < i; j++) { firingDelays[j] = firstDelay; }
+#endif
+    next.nEvents++;
+  }
+
+#ifdef PREDEFINED_PULSE_LENGTH
+  // Each gate is lowered after its own pulse width from the event firing it, at most at the usual
+  // gate-off. The ends of the pulses are merged as the firings, but into the latest one, so no
+  // pulse is shortened.
+  const int firstFired = alwaysOnCounter;
+  int nFired = 0;
+  uint16_t pulseEnds[N];
+  thyristor_count_t order[N];
+  for (int j = firstFired; j < i; j++) {
+    uint32_t end = (uint32_t)firingDelays[j] + thyristors[j]->pulseWidth;
+    if (end > semiPeriodLength - gateTurnOffTime) { end = semiPeriodLength - gateTurnOffTime; }
+    pulseEnds[j] = end;
+    // Insertion sort by end of the pulse
+    int k = nFired++;
+    while (k > 0 && pulseEnds[order[k - 1]] > end) {
+      order[k] = order[k - 1];
+      k--;
+    }
+    order[k] = j;
+  }
+
+  gpio_port_t endPorts[N];
+  gpio_mask_t endMasks[N];
+  for (int j = 0; j < nFired; j++) {
+    endPorts[j] = ports[order[j]];
+    endMasks[j] = masks[order[j]];
+  }
+
+  struct FiringEvent ends[N];
+  thyristor_count_t nEnds = 0;
+  for (int j = 0; j < nFired;) {
+    const int first = j;
+    for (j++; j < nFired && pulseEnds[order[j]] - pulseEnds[order[first]] < mergePeriod; j++)
+      ;
+    struct FiringEvent &end = ends[nEnds++];
+    end.ticks = compensatedTicks(pulseEnds[order[j - 1]], semiPeriodLength - gateTurnOffTime,
+                                 latency);
+    end.gates = appendGates(next, nWrites, endPorts, endMasks, first, j);
+    end.off = true;
+#ifdef GATE_TRACE
+    end.pins = 0;
+    for (int k = first; k < j; k++) { end.pins |= tracePins(order[k], order[k] + 1); }
+#endif
+  }
+
+  // Interleave them with the firings by time, from the tail. On the same time, the firing is first.
+  thyristor_count_t nFirings = next.nEvents;
+  thyristor_count_t n = nFirings + nEnds;
+  next.nEvents = n;
+  while (nEnds > 0) {
+    if (nFirings > 0 && next.events[nFirings - 1].ticks > ends[nEnds - 1].ticks) {
+      next.events[--n] = next.events[--nFirings];
+    } else {
+      next.events[--n] = ends[--nEnds];
+    }
+  }
+#endif
+
+#ifndef PREDEFINED_PULSE_LENGTH
+  // The last event turns off the gates' signal just before the end of the semi-period
+  struct FiringEvent &event = next.events[next.nEvents];
+  event.ticks = compensatedTicks(semiPeriodLength - gateTurnOffTime,
+                                 semiPeriodLength - gateTurnOffTime, latency);
+  event.gates = appendGates(next, nWrites, ports, masks, alwaysOnCounter, nThyristors);
+#ifdef GATE_TRACE
+  event.pins = tracePins(alwaysOnCounter, nThyristors);
+#endif
+#endif
+
+#ifdef ZC_PLL
+  const timer_ticks_t nominalPeriod = semiPeriodLength ? microsecond2TimerTicks(semiPeriodLength) : 0;
+#endif
+
+#ifdef PIO_ENGINE_AVAILABLE
+  // The same schedule as levels of the gates for the PIO engine. It fires each gate on its own at
+  // the exact time, so neither merging nor latency compensation are needed.
+  if (semiPeriodLength > 0) {
+    struct PioStep steps[PIO_ENGINE_STEPS];
+    uint32_t gates = 0;
+    uint32_t levels = 0;
+    for (int i = 0; i < nThyristors; i++) { gates |= pioLevel(thyristors[i]->pin); }
+    for (int i = 0; i < alwaysOnCounter; i++) { levels |= pioLevel(thyristors[i]->pin); }
+
+    const uint16_t gateOff = semiPeriodLength - gateTurnOffTime;
+    const struct PioStep gateOffStep = { compensatedTicks(gateOff, gateOff, 0), levels };
+    uint8_t n = 0;
+    steps[n++] = { 0, levels };
+    for (int i = alwaysOnCounter; i < nThyristors && delays[i] < semiPeriodLength; i++) {
+      levels |= pioLevel(thyristors[i]->pin);
+      steps[n++] = { compensatedTicks(delays[i], gateOff, 0), levels };
+    }
+    // The gate-off step fills the fixed length of the table
+    while (n < PIO_ENGINE_STEPS) { steps[n++] = gateOffStep; }
+    pioEngineLoad(steps, gates);
+  }
+#endif
+
+  // Publish the new snapshot and take back the one not yet consumed by the ISR (if any)
+#ifdef BURST_FIRE
+  lastPublishedSnapshot = threadSnapshot;
+#endif
+  noInterrupts();
+  uint8_t old = exchangePublished(threadSnapshot | SNAPSHOT_FRESH);
+#ifdef ZC_PLL
+  pllNominalPeriod = nominalPeriod;
+#endif
+  interrupts();
+  threadSnapshot = old & ~SNAPSHOT_FRESH;
+  // Then the caller checks interruptEnabled, see Thyristor::disableInterrupt()
+  memoryBarrier();
+}
+
+thyristor_count_t Thyristor::nThyristors = 0;
 Thyristor* Thyristor::thyristors[Thyristor::N] = { nullptr };
-bool Thyristor::newDelayValues = false;
-bool Thyristor::updatingStruct = false;
 bool Thyristor::allThyristorsOnOff = true;
 uint8_t Thyristor::syncPin = 255;
 decltype(RISING) Thyristor::syncDir = RISING;
@@ -20,6 +20,7 @@
 #ifndef THYRISTOR_H
 #define THYRISTOR_H
 
+#include "fast_gpio.h"
 #include <Arduino.h>
 
 /**
@@ -44,6 +45,81 @@
 // If enabled, you can monitor the actual frequency of the electrical network.
 //#define MONITOR_FREQUENCY
 
+// Force the signal length of thyristor's gate, see Thyristor::setPulseWidth(). Each pulse is ended
+// by its own timer event, so the ISRs never wait. If not enabled, the signal to gate is turned off
+// through an interrupt just before the end of the period (see gateTurnOffTime in thyristor.cpp).
+//#define PREDEFINED_PULSE_LENGTH
+
+// If enabled, a thyristor can be driven in burst-fire (integral-cycle) mode, see
+// Thyristor::setBurstFire(): it conducts whole semi-periods, switched only at the zero cross, which
+// suits resistive loads such as heaters. It excludes HW_COMPARE_GATES, MCPWM_GATES and PIO_ENGINE
+// (see thyristor.cpp).
+//#define BURST_FIRE
+
+#ifdef BURST_FIRE
+// Capacity of the burst-fire pattern, in GPIO masks: each semi-period of the pattern takes a mask
+// per GPIO port of the thyristors in burst-fire mode. The pattern is shortened to fit, rounding the
+// duties.
+#ifndef BURST_PATTERN_SIZE
+#if defined(ARDUINO_ARCH_AVR)
+#define BURST_PATTERN_SIZE 64
+#else
+#define BURST_PATTERN_SIZE 256
+#endif
+#endif
+#endif
+
+// If enabled, the ISRs collect statistics about their execution time and the missed deadlines,
+// see Thyristor::getStats(). It costs a few microseconds per interrupt.
+//#define ISR_STATS
+
+// If enabled, the Merge Period (i.e. the window of the delays fired by the same interrupt) is sized
+// on the cost of the timer interrupt, instead of being a constant: the cost is measured in begin(),
+// then while firing the thyristors, and the Merge Period is resized by Thyristor::calibrate().
+//#define ADAPTIVE_MERGE_PERIOD
+
+// If enabled, the ISRs can record the transitions of the gates and the zero crosses into a ring
+// buffer, to be streamed over the serial port (see Thyristor::drainTrace()). The recording is
+// toggled at runtime by Thyristor::setTraceEnabled().
+//#define GATE_TRACE
+
+#ifdef GATE_TRACE
+// Number of records of the trace buffer, it must be a power of 2
+#ifndef GATE_TRACE_SIZE
+#if defined(ARDUINO_ARCH_AVR)
+#define GATE_TRACE_SIZE 32
+#else
+#define GATE_TRACE_SIZE 256
+#endif
+#endif
+#endif
+
+#ifdef ISR_STATS
+// Number of bins of the histograms of the ISR execution times
+#ifndef ISR_STATS_BINS
+#define ISR_STATS_BINS 12
+#endif
+#endif
+
+// Maximum number of thyristors that can be instantiated. The ISRs keep a few bytes per thyristor,
+// so don't increase it more than needed. Remember to check *mergePeriod* in thyristor.cpp when
+// controlling many thyristors.
+#ifndef MAX_THYRISTORS
+#define MAX_THYRISTORS 8
+#endif
+
+static_assert(MAX_THYRISTORS > 0, "MAX_THYRISTORS must be greater than 0");
+
+/**
+ * Type to count and index the thyristors. The ISRs index up to 3 GPIO writes per thyristor, hence
+ * it is widened when needed.
+ */
+#if MAX_THYRISTORS * 3 < 256
+typedef uint8_t thyristor_count_t;
+#else
+typedef uint16_t thyristor_count_t;
+#endif
+
 /**
  * This is the core class of this library, that provides the finest control on thyristors.
  *
@@ -74,6 +150,12 @@ public:
    */
   void setDelay(uint16_t delay);
 
+  /**
+   * Set the delays of multiple thyristors at once: delays[i] is the delay of targets[i].
+   * The thyristors are reordered only once and the new delays are applied in the same semi-period.
+   */
+  static void setDelays(Thyristor *const targets[], const uint16_t delays[], thyristor_count_t n);
+
   /**
    * Return the current delay.
    */
@@ -86,6 +168,46 @@ public:
    */
   void turnOn();
 
+#ifdef BURST_FIRE
+  /**
+   * Switch to burst-fire mode: the thyristor conducts the given number of semi-periods out of each
+   * window of semi-periods, spread as evenly as possible. The conducting semi-periods of the
+   * thyristors in this mode are staggered, to keep their total current as flat as possible. The
+   * gate is raised at the zero cross, so the ISRs don't need any timer event. setDelay(..) switches
+   * back to phase control. The number of semi-periods is limited to the window, a window of 0 is
+   * ignored.
+   *
+   * NOTE: the pattern of all the thyristors repeats every least common multiple of the windows:
+   * if it doesn't fit BURST_PATTERN_SIZE, the duties are rounded. Windows that are divisors of
+   * each other (e.g. 10, 20 and 50) avoid the rounding.
+   */
+  void setBurstFire(uint16_t onSemiPeriods, uint16_t window);
+
+  /**
+   * Tell if the thyristor is in burst-fire mode.
+   */
+  bool isBurstFire() const {
+    return burstWindow != 0;
+  }
+#endif
+
+#ifdef PREDEFINED_PULSE_LENGTH
+  /**
+   * Set the length of the pulse on the gate, in microseconds (15 by default). The pulse ends at
+   * most just before the end of the semi-period, and it is not applied if the thyristor is fully
+   * on. The ends of the pulses closer than the Merge Period are merged, so a pulse may be longer
+   * by up to the Merge Period.
+   */
+  void setPulseWidth(uint16_t width);
+
+  /**
+   * Return the length of the pulse on the gate, in microseconds.
+   */
+  uint16_t getPulseWidth() const {
+    return pulseWidth;
+  }
+#endif
+
   /**
    * Turn off the thyristor.
    */
@@ -100,10 +222,26 @@ public:
    */
   static void begin();
 
+#ifdef ARDUINO_ARCH_ESP32
+  /**
+   * Set the core serving the zero-cross and timer interrupts, e.g. 1 to keep them away from the
+   * Wi-Fi stack. By default it is the core calling begin(). It must be called before begin(), and
+   * before any attachInterrupt(..) of the sketch: the GPIO interrupts of all the pins are served by
+   * the core of the first one.
+   *
+   * The other methods can be called from any core and any task, but by one task at a time: the
+   * mailbox carrying the new configuration to the ISRs has a single producer, and the thyristors
+   * are sorted by delay in place. If several tasks change the dimmers, serialize them (e.g. with a
+   * FreeRTOS mutex), or let a single task apply the changes requested by the others through a
+   * queue. getStats() and getIsrLatency() are safe from any task.
+   */
+  static void setInterruptCore(uint8_t core);
+#endif
+
   /**
    * Return the number of instantiated thyristors.
    */
-  static uint8_t getThyristorNumber() {
+  static thyristor_count_t getThyristorNumber() {
     return nThyristors;
   };
 
@@ -139,6 +277,39 @@ public:
    */
   static uint16_t getSemiPeriod();
 
+  /**
+   * Set the offset of the zero-cross signal w.r.t. the actual zero crossing of the voltage, in
+   * microseconds: positive if the signal comes later (e.g. the detector triggers above a voltage
+   * threshold), negative if it comes earlier. It should include the latency of the zero-cross
+   * interrupt. The offset is compensated in the firing times, so the delays refer to the actual
+   * zero crossing. It is bounded to [-1000; 1000], default 0.
+   */
+  static void setZeroCrossOffset(int16_t offset);
+
+  /**
+   * Get the offset of the zero-cross signal.
+   */
+  static int16_t getZeroCrossOffset();
+
+  /**
+   * Get the latency of the timer interrupt, in microseconds. It is constantly measured while the
+   * thyristors are fired and it is compensated in the firing times.
+   */
+  static uint16_t getIsrLatency();
+
+  /**
+   * Apply the latest latency measurement to the firing times. This is also done on every update of
+   * the delays. With ADAPTIVE_MERGE_PERIOD, also resize the Merge Period on the latest measurement
+   * of the ISR cost.
+   */
+  static void calibrate();
+
+  /**
+   * Get the Merge Period, in microseconds: the thyristors whose delays are closer than it are fired
+   * by the same interrupt, the later ones up to Merge Period early.
+   */
+  static uint16_t getMergePeriod();
+
 #ifdef NETWORK_FREQ_RUNTIME
   /**
    * Set target frequency. Negative values are ignored;
@@ -156,6 +327,11 @@ public:
    */
   static float getDetectedFrequency();
 
+  /**
+   * Same as getDetectedFrequency(), but in millihertz. It doesn't need floating point arithmetic.
+   */
+  static uint32_t getDetectedFrequencyMilliHz();
+
   /**
    * Check if frequency monitor is always enabled.
    */
@@ -172,7 +348,133 @@ public:
   static void frequencyMonitorAlwaysOn(bool enable);
 #endif
 
-  static const uint8_t N = 8;
+#ifdef ISR_STATS
+  /**
+   * Execution time of an interrupt routine, in CPU cycles. The resolution is 1 cycle on ESP8266,
+   * ESP32, SAMD and RP2040, and 64 cycles on AVR (the cycles are derived from Timer0).
+   */
+  struct IsrProfile {
+    uint32_t count;
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    /**
+     * Logarithmic histogram: bin 0 counts the executions shorter than 64 cycles, bin i those in
+     * [32 * 2^i; 64 * 2^i), and the last bin all the longer ones.
+     */
+    uint32_t histogram[ISR_STATS_BINS];
+  };
+
+  struct Stats {
+    /**
+     * Zero-cross interrupts, including the filtered ones.
+     */
+    IsrProfile zeroCross;
+
+    /**
+     * Timer interrupts turning on the thyristors.
+     */
+    IsrProfile activate;
+
+    /**
+     * Timer interrupts turning off the gates.
+     */
+    IsrProfile turnOff;
+
+    /**
+     * Started semi-periods.
+     */
+    uint32_t semiPeriods;
+
+    /**
+     * Semi-periods ended before firing all the thyristors, e.g. because of a premature zero cross.
+     */
+    uint32_t unmanagedSemiPeriods;
+
+    /**
+     * Timer events already due when armed, hence served late within the previous interrupt.
+     */
+    uint32_t lateEvents;
+
+    /**
+     * Timer interrupts executed too late to measure the interrupt latency (see getIsrLatency()).
+     */
+    uint32_t overruns;
+
+    /**
+     * Shortest and longest interval between zero-cross interrupts, in microseconds. Intervals
+     * longer than 65535us (e.g. while the interrupt is disabled) are not considered.
+     */
+    uint16_t minZeroCrossInterval;
+    uint16_t maxZeroCrossInterval;
+  };
+
+  /**
+   * Return a consistent copy of the statistics collected since begin() or the last resetStats().
+   * It can be called from loop(), the ISRs are blocked only for the time of the copy.
+   */
+  static Stats getStats();
+
+  /**
+   * Clear the statistics.
+   */
+  static void resetStats();
+#endif
+
+#ifdef GATE_TRACE
+  enum TraceType : uint8_t {
+    /**
+     * Zero-cross interrupt, before any filtering.
+     */
+    TRACE_ZERO_CROSS = 'Z',
+    /**
+     * Start of a semi-period, by the zero-cross interrupt or by the timer (see ZC_PLL).
+     */
+    TRACE_SEMI_PERIOD = 'S',
+    TRACE_GATES_HIGH = 'H',
+    TRACE_GATES_LOW = 'L',
+    /**
+     * Records dropped because the buffer was full, *pins* holds their number.
+     */
+    TRACE_DROPPED = 'D',
+  };
+
+  struct TraceRecord {
+    /**
+     * Mask of the gate pins changed by this event, bit i is pin i. Pins above 63 are not traced.
+     */
+    uint64_t pins;
+
+    /**
+     * Timestamp, in microseconds (i.e. micros()).
+     */
+    uint32_t time;
+
+    TraceType type;
+  };
+
+  /**
+   * Start or stop the recording. When stopped, the ISRs only check this flag.
+   */
+  static void setTraceEnabled(bool enable);
+
+  static bool isTraceEnabled();
+
+  /**
+   * Move up to *max* records, from the oldest one, into the given array. Return the number of
+   * records moved.
+   */
+  static uint16_t readTrace(TraceRecord records[], uint16_t max);
+
+  /**
+   * Print the recorded events as text lines "<time> <type> <pins>", from the oldest one, where
+   * type is the TraceType character and pins is in hexadecimal. Call it often enough from loop() to
+   * avoid the overflow of the buffer. The output can be converted to VCD with
+   * extras/trace2vcd.py.
+   */
+  static void drainTrace(Print &out = Serial);
+#endif
+
+  static const thyristor_count_t N = MAX_THYRISTORS;
 
 private:
   /**
@@ -189,32 +491,55 @@ private:
    * Search if all the values are only on and off.
    * Return true if all are on/off, false otherwise.
    */
-  bool areThyristorsOnOff();
+  static bool areThyristorsOnOff();
 
   /**
-   * Number of instantiated thyristors.
+   * Sort the array of thyristors by delay and update their position.
    */
-  static uint8_t nThyristors;
+  static void sortThyristors();
 
   /**
-   * Vector of instatiated thyristors.
+   * Enable the zero cross interrupt, if disabled.
    */
-  static Thyristor *thyristors[];
+  static void enableInterrupt();
+
+  /**
+   * Disable the zero cross interrupt from its ISR, unless a new snapshot has been published
+   * meanwhile. Return true if disabled.
+   */
+  static bool disableInterrupt();
+
+  /**
+   * Attach the zero-cross routine to the sync pin, through the input capture of the timer if
+   * enabled and available (see ZC_HW_CAPTURE).
+   */
+  static void attachZeroCross();
+
+  static void detachZeroCross();
 
   /**
-   * Variable to tell to interrupt routine to update its internal structures
+   * Prepare a new snapshot of the thyristors' configuration and hand it over to the ISRs.
+   * The ISRs take it at the next zero cross, so this methods must be called every time the
+   * thyristors' array is modified.
    */
-  static bool newDelayValues;
+  static void publishSnapshot();
 
+#ifdef GATE_TRACE
   /**
-   * Variable to avoid concurrency problem between interrupt and threads.
-   * In particular, this variable is used to prevent the copy of the memory used by
-   * the array of struct during reordering (interrupt can continue because it
-   * keeps its own copy of the array).
-   * A condition variable does not make sense because interrupt routine cannot be
-   * stopped.
+   * Return the mask of the pins of the thyristors in [from; to), see TraceRecord.
    */
-  static bool updatingStruct;
+  static uint64_t tracePins(int from, int to);
+#endif
+
+  /**
+   * Number of instantiated thyristors.
+   */
+  static thyristor_count_t nThyristors;
+
+  /**
+   * Vector of instatiated thyristors.
+   */
+  static Thyristor *thyristors[];
 
   /**
    * This variable tells if the thyristors are completely ON and OFF,
@@ -258,20 +583,49 @@ private:
    */
   uint8_t pin;
 
+  /**
+   * Port and mask of the pin, resolved at construction time to drive the gate from the ISRs.
+   */
+  gpio_port_t gatePort;
+  gpio_mask_t gateMask;
+
   /**
    * Position into the static array, this is used to speed up the research
    * operation while setting the new brightness value.
    */
-  uint8_t posIntoArray;
+  thyristor_count_t posIntoArray;
 
   /**
    * Time to wait before turning on the thryristor.
    */
   uint16_t delay;
 
+#ifdef PREDEFINED_PULSE_LENGTH
+  /**
+   * Length of the pulse on the gate, in microseconds.
+   */
+  uint16_t pulseWidth;
+#endif
+
+#ifdef BURST_FIRE
+  /**
+   * Semi-periods to conduct out of each window, see setBurstFire(..). A window of 0 means phase
+   * control.
+   */
+  uint16_t burstOn;
+  uint16_t burstWindow;
+#endif
+
+#ifdef ARDUINO_ARCH_NATIVE
+  // The host benchmarks measure the private methods too (see extras/native)
+  friend class ThyristorBenchmark;
+#endif
+
   friend void activate_thyristors();
   friend void zero_cross_int();
+  friend void start_semi_period();
   friend void turn_off_gates_int();
+  friend void core1_main();
 };
 
 #endif  // END THYRISTOR_H